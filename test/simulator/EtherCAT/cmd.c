@@ -7,8 +7,10 @@
 #include "cmd_EAT.h"
 #include "cmd_IcePAP.h"
 #include "cmd_TCPsim.h"
+#include "cmd_ADS.h"
 #include "logerr_info.h"
 #include "cmd_buf.h"
+#include "cmd.h"
 
 void dump_to_std(const char *buf,
                  unsigned len,
@@ -53,44 +55,36 @@ void dump_and_send(int fd, int flags, const char *buf, unsigned len)
   if ((flags & PRINT_OUT) || PRINT_STDOUT_BIT1()) {
     dump_to_std(buf, len, "OUT", 0, 0);
   }
-  send_to_socket(fd, buf, len);
+  send_to_socket(fd, buf, len, flags & PRINT_ADD_CR);
 }
 /*****************************************************************************/
+/*
+ * Short output is formatted on the stack, only longer output
+ * needs the heap.  send_to_socket() adds the '\r'
+ */
 static int fd_vprintf_crlf(int fd, int flags, const char* format, va_list arg)
 {
-  const static size_t len = 4096;
-  int add_cr = flags & PRINT_ADD_CR;
+  char stack_buf[1024];
+  char *buf = stack_buf;
+  va_list arg_copy;
+  int res;
 
-  char *buf = calloc(len,1);
-  int res = vsnprintf(buf, len-1, format, arg);
-  if (res > 0 && !add_cr) {
+  va_copy(arg_copy, arg);
+  res = vsnprintf(stack_buf, sizeof(stack_buf), format, arg_copy);
+  va_end(arg_copy);
+  if (res >= (int)sizeof(stack_buf)) {
+    buf = malloc(res + 1);
+    if (!buf) {
+      return -1;
+    }
+    res = vsnprintf(buf, res + 1, format, arg);
+  }
+  if (res > 0) {
     dump_and_send(fd, flags, buf, res);
   }
-  else if (res > 0)
-  {
-    unsigned src_idx = 0;
-    unsigned dst_idx = 0;
-    char *buf2 = calloc(2*res, 1);
-    char oldc = 0;
-    for (src_idx=0; src_idx < res; src_idx++)
-    {
-      char c = buf[src_idx];
-      buf2[dst_idx] = c;
-#if 1
-      if ((c == '\n') && (oldc != '\r')) {
-        buf2[dst_idx++] = '\r';
-        buf2[dst_idx] = '\n';
-      }
-#else
-      (void)oldc;
-#endif
-      oldc = c;
-      dst_idx++;
-    }
-    dump_and_send(fd, flags, buf2, dst_idx);
-    free(buf2);
+  if (buf != stack_buf) {
+    free(buf);
   }
-  free(buf);
   return res;
 }
 
@@ -107,83 +101,183 @@ void fd_printf_crlf(int fd, int add_cr, const char *format, ...)
 
 
 
-static int create_argv(const char *line, int had_cr, int had_lf, const char*** argv_p)
+/*
+ * Split the line in place into spans, nothing is allocated or copied.
+ * argv[0] spans the whole line, the following spans are the arguments.
+ * A line with a ' ' is split at the spaces, otherwise at the ';'.
+ * The separator after an argument is overwritten with '\0', so that
+ * the handlers can use the C string functions on argv[n].ptr, n > 0.
+ * argv[0] is a (ptr, len) span only, with '\0' inside: argv[0].ptr
+ * as a C string is just the first argument.
+ * If there are more than max_args - 1 arguments, the last span
+ * keeps the rest of the line.
+ */
+static int tokenize_line(char *line, int had_cr, int had_lf,
+                         cmd_span_type *argv, int max_args)
 {
-  char *input_line = strdup(line);
-  size_t calloc_len = 2 + strlen(input_line);
+  size_t line_len = strlen(line);
+  char sep = ';';
+  char *p = line;
+  char *end = line + line_len;
   int argc = 0;
-  /* Allocate an array big enough, could be max strlen/2
-     space <-> non-space transitions */
-  const char **argv; /* May be more */
 
   if (PRINT_STDOUT_BIT0()) {
-    dump_to_std(line, (unsigned)strlen(line), "IN", had_cr, had_lf);
-  }
-
-  argv = (const char **) (void *)calloc(calloc_len, sizeof(char *));
-  *argv_p = argv;
-  if (argv  == NULL)
-  {
-    return 0;
+    dump_to_std(line, (unsigned)line_len, "IN", had_cr, had_lf);
   }
-  /* argv[0] is the whole line */
-  argv[argc++] = strdup(input_line);;
-  if (!strlen(input_line)) {
-    fprintf(stdlog, "%s/%s:%d argc=%d (Early return)\n", __FILE__, __FUNCTION__, __LINE__,
-            argc);
-    return argc;
+  argv[argc].ptr = line;
+  argv[argc].len = (unsigned)line_len;
+  argc++;
+  if (memchr(line, ' ', line_len)) {
+    sep = ' ';
   }
-  if (strchr(input_line, ' ') != NULL) {
-    /* Start the loop */
-    char *arg = strtok(input_line, " ");
-    while (arg) {
-      argv[argc++] = strdup(arg);
-      arg = strtok(NULL, " ");
+  while (p < end && argc < max_args) {
+    char *arg_end;
+    if (*p == sep) {
+      /* Empty arguments are skipped */
+      p++;
+      continue;
     }
-  } else if (strchr(input_line, ';') != NULL) {
-    /* Start the loop */
-    char *arg = strtok(input_line, ";");
-    while (arg) {
-      argv[argc++] = strdup(arg);
-      arg = strtok(NULL, ";");
+    arg_end = (argc < max_args - 1) ? memchr(p, sep, end - p) : NULL;
+    if (!arg_end) {
+      arg_end = end;
     }
-  } else {
-    argv[argc++] = strdup(input_line);
+    argv[argc].ptr = p;
+    argv[argc].len = (unsigned)(arg_end - p);
+    argc++;
+    *arg_end = '\0';
+    p = arg_end + 1;
   }
-
-  free(input_line);
   if (PRINT_STDOUT_BIT2()) {
-    fprintf(stdlog, "%s/%s:%d argc=%d calloc_len=%u\n", __FILE__, __FUNCTION__, __LINE__,
-            argc, (unsigned)calloc_len);
-    {
-      int i;
-      for(i=0; i <= argc;i++) {
-        fprintf(stdlog, "%s/%s:%d argv[%d]=\"%s\"\n", __FILE__, __FUNCTION__, __LINE__,
-                i, argv[i] ? argv[i] : "NULL");
-      }
+    int i;
+    fprintf(stdlog, "%s/%s:%d argc=%d\n", __FILE__, __FUNCTION__, __LINE__,
+            argc);
+    for (i = 1; i < argc; i++) {
+      fprintf(stdlog, "%s/%s:%d argv[%d]=\"%.*s\"\n",
+              __FILE__, __FUNCTION__, __LINE__,
+              i, (int)argv[i].len, argv[i].ptr);
     }
   }
-
   return argc;
 }
 
 /*****************************************************************************/
-int handle_input_line(int socket_fd, const char *input_line, int had_cr, int had_lf)
+/*
+ * The port and the socket of the line which is handled right now.
+ * Each worker thread handles its own lines, without a global lock
+ */
+static __thread const port_cfg_type *cur_port_cfg;
+static __thread int cur_socket_fd = -1;
+/* How the response of the line is sent, and if parts of it have been
+   sent: -1 if the response must be sent as a whole */
+static __thread int cur_flags;
+static __thread int cur_sent_part = -1;
+
+int cmd_axis_no_to_hw(int cmd_axis_no)
+{
+  if (cur_port_cfg && cur_port_cfg->num_axes) {
+    if (cmd_axis_no < 1 || cmd_axis_no > cur_port_cfg->num_axes) {
+      return 0;
+    }
+    return cur_port_cfg->first_axis - 1 + cmd_axis_no;
+  }
+  return cmd_axis_no;
+}
+
+int cmd_port_num_axes(void)
+{
+  return cur_port_cfg ? cur_port_cfg->num_axes : 0;
+}
+
+int cmd_socket_fd(void)
+{
+  return cur_socket_fd;
+}
+
+/*****************************************************************************/
+/* What a line is, apart from a command of the command set */
+#define LINE_CMD     0
+#define LINE_BYE     1
+#define LINE_KILL    2
+#define LINE_TIMEOUT 3
+#define LINE_SIM     4
+
+static const char this_stSettings_iTimeOut_str_s[] = ".THIS.stSettings.iTimeOut=";
+static const char sim_str_s[] = "Sim.";
+
+/*
+ * One look at the first character picks the only prefix
+ * which can match, the rest of the line is not scanned.
+ */
+static int classify_line(const char *argv1, int personality)
+{
+  switch (argv1[0]) {
+    case 'b':
+      if (!strcmp(argv1, "bye")) {
+        return LINE_BYE;
+      }
+      break;
+    case 'k':
+      if (!strcmp(argv1, "kill")) {
+        return LINE_KILL;
+      }
+      break;
+    case '.':
+      if ((personality == PERSONALITY_AUTO || personality == PERSONALITY_EAT) &&
+          !strncmp(argv1, this_stSettings_iTimeOut_str_s,
+                   sizeof(this_stSettings_iTimeOut_str_s) - 1)) {
+        return LINE_TIMEOUT;
+      }
+      break;
+    case 'S':
+      if (!strncmp(argv1, sim_str_s, sizeof(sim_str_s) - 1)) {
+        return LINE_SIM;
+      }
+      break;
+    default:
+      break;
+  }
+  return LINE_CMD;
+}
+
+/*****************************************************************************/
+/*
+ * personality belongs to the connection.  It starts as the one of
+ * the listening port; on an "auto" port the first line with a valid
+ * command decides, and the following lines go straight to that
+ * command set.
+ */
+int handle_input_line(int socket_fd, const port_cfg_type *port_cfg,
+                      int *personality,
+                      char *input_line, int had_cr, int had_lf)
 {
   static const char *seperator_seperator = ";";
   static const char *terminator_terminator = "\n";
-  const char *this_stSettings_iTimeOut_str_s = ".THIS.stSettings.iTimeOut=";
-  const char *sim_str_s = "Sim.";
 
   static unsigned int counter;
 
-  const char **my_argv = NULL;
-  int argc = create_argv(input_line, had_cr, had_lf, (const char*** )&my_argv);
-  const char *argv1 = (argc > 1) ? my_argv[1] : "";
-  int is_EAT_cmd = strchr(input_line, ';') != NULL;
+  cmd_span_type my_argv[CMD_ARGS_MAX];
+  /* Before the separators are overwritten, only needed to find out */
+  int is_eat_line = (*personality == PERSONALITY_AUTO) &&
+    strchr(input_line, ';') != NULL;
+  int argc = tokenize_line(input_line, had_cr, had_lf,
+                           my_argv, CMD_ARGS_MAX);
+  const char *argv1 = (argc > 1) ? my_argv[1].ptr : "";
+  int line_type = classify_line(argv1, *personality);
+  int handled = 1;
 
-  if (!strncmp(argv1, this_stSettings_iTimeOut_str_s, strlen(this_stSettings_iTimeOut_str_s))) {
-    const char *myarg_1 = &argv1[strlen(this_stSettings_iTimeOut_str_s)];
+  cur_port_cfg = port_cfg;
+  cur_socket_fd = socket_fd;
+  cur_flags = had_cr ? PRINT_ADD_CR : 0;
+  cur_sent_part = 0;
+  if (line_type == LINE_BYE) {
+    fprintf(stdlog, "%s/%s:%d bye\n", __FILE__, __FUNCTION__, __LINE__);
+    return 1;
+  }
+  else if (line_type == LINE_KILL) {
+    exit(0);
+  }
+  else if (line_type == LINE_TIMEOUT) {
+    const char *myarg_1 = &argv1[sizeof(this_stSettings_iTimeOut_str_s) - 1];
     int timeout;
     int nvals;
     nvals = sscanf(myarg_1, "%d", &timeout);
@@ -200,25 +294,39 @@ int handle_input_line(int socket_fd, const char *input_line, int had_cr, int had
                      terminator_terminator);
     }
   }
-  else if (!strncmp(argv1, sim_str_s, strlen(sim_str_s))) {
+  else if (line_type == LINE_SIM) {
     cmd_Sim(argc, my_argv);
-  } else if (is_EAT_cmd) {
-    cmd_EAT(argc, my_argv);
-  }
-  else if ((argc > 1) && (0 == strcmp(argv1, "bye"))) {
-    fprintf(stdlog, "%s/%s:%d bye\n", __FILE__, __FUNCTION__, __LINE__);
-    return 1;
-  }
-  else if ((argc > 1) && (0 == strcmp(argv1, "kill"))) {
-    exit(0);
-  }
-#if 0
-  else if (cmd_TCPsim(argc, my_argv)) {
-    ; /* TCPsim command */
+  } else {
+    /* The command set of the connection */
+    switch (*personality) {
+      case PERSONALITY_EAT:
+        if (argc > 1) {
+          cmd_EAT(argc, my_argv);
+        } else {
+          handled = 0;
+        }
+        break;
+      case PERSONALITY_ICEPAP:
+        handled = cmd_IcePAP(argc, my_argv);
+        break;
+      case PERSONALITY_TCPSIM:
+        handled = cmd_TCPsim(argc, my_argv);
+        break;
+      default:
+        /* Find out from the line, and keep it */
+        if (is_eat_line) {
+          *personality = PERSONALITY_EAT;
+          cmd_EAT(argc, my_argv);
+        } else {
+          handled = cmd_IcePAP(argc, my_argv);
+          if (handled) {
+            *personality = PERSONALITY_ICEPAP;
+          }
+        }
+    }
   }
-#endif
-  else if (cmd_IcePAP(argc, my_argv)) {
-    ; /* IcePAP command */
+  if (handled) {
+    ; /* Done */
   }
   else if (argv1[0] == 'h' ||
            argv1[0] == '?') {
@@ -235,27 +343,101 @@ int handle_input_line(int socket_fd, const char *input_line, int had_cr, int had
   else if (argc == 1) {
     /* Just a return, print a prompt */
   }
-  {
-    int i;
-    for (i=0; i < argc; i++)
-    {
-      free((void *)my_argv[i]);
-    }
-    free(my_argv);
-  }
   if (PRINT_STDOUT_BIT2()) {
     fprintf(stdlog, "%s/%s:%d (%u)\n",
             __FILE__, __FUNCTION__, __LINE__,
-            counter++);
+            __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
   }
   {
-    int flags = had_cr ? PRINT_ADD_CR : 0;
-    const char *buf = get_buf();
+    /* The response is formatted already, copy it to the output */
+    size_t len = get_buf_len();
 
-    fd_printf_crlf(socket_fd, flags, "%s", buf);
+    if (len || cur_sent_part > 0) {
+      dump_and_send(socket_fd, cur_flags, get_buf(), (unsigned)len);
+    }
     clear_buf();
+    cur_sent_part = -1;
   }
 
   return 0;
 }
 
+/*****************************************************************************/
+void cmd_send_part(void)
+{
+  size_t len = get_buf_len();
+
+  if (cur_sent_part < 0 || len < CMD_SEND_PART_LEN) {
+    return;
+  }
+  if (PRINT_STDOUT_BIT1()) {
+    dump_to_std(get_buf(), (unsigned)len, "OUT", 0, 0);
+  }
+  send_part_to_socket(cur_socket_fd, get_buf(), (unsigned)len,
+                      cur_flags & PRINT_ADD_CR);
+  clear_buf();
+  cur_sent_part = 1;
+}
+
+/*****************************************************************************/
+/*
+ * Binary protocols are not split into lines: handle the frame at the
+ * start of buf, and send the response.
+ * Returns the length of the frame, 0 if it is not complete yet,
+ * -1 if the connection should be closed
+ */
+int handle_input_frame(int socket_fd, const port_cfg_type *port_cfg,
+                       const unsigned char *buf, size_t len)
+{
+  int frame_len;
+  size_t out_len;
+
+  cur_port_cfg = port_cfg;
+  cur_socket_fd = socket_fd;
+  cur_sent_part = -1; /* A frame is sent as a whole */
+  frame_len = cmd_ADS(buf, len);
+  out_len = get_buf_len();
+  if (out_len) {
+    dump_and_send(socket_fd, 0, get_buf(), (unsigned)out_len);
+  }
+  clear_buf();
+  return frame_len;
+}
+
+/*****************************************************************************/
+int input_frame_len(const unsigned char *buf, size_t len)
+{
+  return cmd_ADS_frame_len(buf, len);
+}
+
+/*****************************************************************************/
+/*
+ * The value of a subscription is added to the cmd_buf,
+ * the caller decides if it is pushed
+ */
+void handle_notify(const port_cfg_type *port_cfg, const char *name)
+{
+  cur_port_cfg = port_cfg;
+  cur_socket_fd = -1;
+  cur_sent_part = -1;
+  cmd_EAT_notify(name);
+}
+
+/*****************************************************************************/
+/* Called by the tick thread, which locks the axes one by one */
+void handle_tick(void)
+{
+  cmd_Sim_tick();
+}
+
+/*****************************************************************************/
+int cmd_set_num_axes(int num_axes)
+{
+  if (cmd_Sim_set_num_axes(num_axes) ||
+      cmd_EAT_alloc_axes() ||
+      cmd_IcePAP_alloc_axes() ||
+      cmd_TCPsim_alloc_axes()) {
+    return -1;
+  }
+  return 0;
+}
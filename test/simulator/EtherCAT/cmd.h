@@ -0,0 +1,49 @@
+#ifndef CMD_H
+#define CMD_H
+
+#include "sock-util.h"
+
+/*
+ * An argument of a command line: it points into the receive buffer,
+ * nothing is copied.  ptr[len] is '\0'.
+ */
+typedef struct cmd_span_type {
+  const char *ptr;
+  unsigned   len;
+} cmd_span_type;
+
+/* Lines from a socket are shorter than INPUT_LINE_MAX bytes, at most
+   every second byte starts an argument.  argv[0] spans the whole line,
+   but has '\0' at the separators: it is no C string */
+#define CMD_ARGS_MAX (1 + INPUT_LINE_MAX / 2)
+
+/*
+ * Map the axis number used in a command to the axis number in hw_motor.
+ * Each port serves its own range of axes, the client counts from 1.
+ * Returns 0 (an invalid axis) if the axis is outside the range.
+ */
+int cmd_axis_no_to_hw(int cmd_axis_no);
+
+/* The number of axes of the port, 0 if it serves all axes unmapped */
+int cmd_port_num_axes(void);
+
+/*
+ * Allocate the axes 1..num_axes of the simulator and of all command
+ * sets, once before the sockets are served.  -1 on error
+ */
+#define NUM_AXES_DEFAULT 8
+#define NUM_AXES_MAX     100000
+int cmd_set_num_axes(int num_axes);
+
+/*
+ * A long response is sent in parts, to keep the cmd_buf short:
+ * send what the cmd_buf has, once it has CMD_SEND_PART_LEN bytes
+ * or more.  The rest follows when the line is handled
+ */
+#define CMD_SEND_PART_LEN 16384
+void cmd_send_part(void);
+
+/* The socket of the line which is handled */
+int cmd_socket_fd(void);
+
+#endif /* CMD_H */
@@ -0,0 +1,374 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "sock-util.h"
+#include "logerr_info.h"
+#include "cmd_buf.h"
+#include "cmd_EAT.h"
+#include "cmd_ADS.h"
+
+/*
+ * A stand-in for binary ADS (AMS/TCP), as spoken by TwinCAT on port 48898.
+ * Read, Write and ReadWrite reach the same parameters as
+ * "ADSPORT=501/.ADR.", ReadWrite on the index groups 0xF080 and 0xF081
+ * is SumRead and SumWrite.  ReadState and ReadDeviceInfo are answered
+ * on every AMS port.
+ *
+ * AMS/TCP header: reserved (2), length of the rest (4)
+ * AMS header:     target net id (6), target port (2),
+ *                 source net id (6), source port (2),
+ *                 command id (2), state flags (2), data length (4),
+ *                 error code (4), invoke id (4)
+ * All numbers are little endian.
+ */
+#define AMS_TCP_HDR_LEN   6
+#define AMS_HDR_LEN       32
+#define AMS_ADDR_LEN      8  /* net id and port */
+#define AMS_OFF_TARGET    0
+#define AMS_OFF_PORT      6
+#define AMS_OFF_SOURCE    8
+#define AMS_OFF_CMD_ID    16
+#define AMS_OFF_FLAGS     18
+#define AMS_OFF_DATA_LEN  20
+#define AMS_OFF_INVOKE_ID 28
+
+#define AMS_STATE_RESPONSE 0x0001
+#define AMS_STATE_ADS_CMD  0x0004
+
+#define ADS_CMD_READ_DEVICE_INFO 1
+#define ADS_CMD_READ             2
+#define ADS_CMD_WRITE            3
+#define ADS_CMD_READ_STATE       4
+#define ADS_CMD_READ_WRITE       9
+
+/* The NC, which has the parameters of the axes */
+#define ADS_PORT_NC         501
+#define ADSIGRP_SUMUP_READ  0xF080
+#define ADSIGRP_SUMUP_WRITE 0xF081
+#define ADSSTATE_RUN        5
+/* group, offset, length of a sub request of SumRead and SumWrite */
+#define ADS_SUM_HDR_LEN     12
+/* The longest parameter, a double */
+#define ADS_VALUE_MAX       8
+/* The longest response to a SumRead */
+#define ADS_SUM_READ_MAX    (64 * 1024)
+/* The longest frame which is received: a SumRead of ADS_SUM_READ_MAX,
+   its sub requests read at least 1 byte each */
+#define ADS_FRAME_MAX       (AMS_TCP_HDR_LEN + AMS_HDR_LEN + 16 + \
+                             ADS_SUM_READ_MAX / (4 + 1) * ADS_SUM_HDR_LEN)
+
+static unsigned get_u16(const unsigned char *p)
+{
+  return p[0] | (unsigned)p[1] << 8;
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void add_u16(unsigned value)
+{
+  unsigned char buf[2];
+  buf[0] = (unsigned char)value;
+  buf[1] = (unsigned char)(value >> 8);
+  add_to_buf((const char *)buf, sizeof(buf));
+}
+
+static void add_u32(uint32_t value)
+{
+  unsigned char buf[4];
+  buf[0] = (unsigned char)value;
+  buf[1] = (unsigned char)(value >> 8);
+  buf[2] = (unsigned char)(value >> 16);
+  buf[3] = (unsigned char)(value >> 24);
+  add_to_buf((const char *)buf, sizeof(buf));
+}
+
+static void add_zeros(size_t len)
+{
+  static const char zeros[64];
+  while (len) {
+    size_t chunk = len < sizeof(zeros) ? len : sizeof(zeros);
+    add_to_buf(zeros, chunk);
+    len -= chunk;
+  }
+}
+
+/* Overwrite a number added before, at offset in the cmd_buf */
+static void set_u32(size_t offset, uint32_t value)
+{
+  unsigned char *p = (unsigned char *)get_buf() + offset;
+  p[0] = (unsigned char)value;
+  p[1] = (unsigned char)(value >> 8);
+  p[2] = (unsigned char)(value >> 16);
+  p[3] = (unsigned char)(value >> 24);
+}
+
+/*
+ * The AMS/TCP and AMS headers of the response, data_len bytes follow.
+ * The source of the request is the target of the response
+ */
+static void add_response_hdr(const unsigned char *ams, uint32_t data_len,
+                             uint32_t error_code)
+{
+  add_u16(0);
+  add_u32(AMS_HDR_LEN + data_len);
+  add_to_buf((const char *)&ams[AMS_OFF_SOURCE], AMS_ADDR_LEN);
+  add_to_buf((const char *)&ams[AMS_OFF_TARGET], AMS_ADDR_LEN);
+  add_u16(get_u16(&ams[AMS_OFF_CMD_ID]));
+  add_u16(AMS_STATE_RESPONSE | AMS_STATE_ADS_CMD);
+  add_u32(data_len);
+  add_u32(error_code);
+  add_to_buf((const char *)&ams[AMS_OFF_INVOKE_ID], 4);
+}
+
+/*****************************************************************************/
+static void ads_read_device_info(const unsigned char *ams)
+{
+  char name[16];
+  memset(name, 0, sizeof(name));
+  strncpy(name, "simMotor", sizeof(name) - 1);
+  add_response_hdr(ams, 4 + 4 + sizeof(name), ADSERR_NOERR);
+  add_u32(ADSERR_NOERR);
+  add_to_buf("\x03\x01", 2); /* version 3.1 */
+  add_u16(0);                /* build */
+  add_to_buf(name, sizeof(name));
+}
+
+static void ads_read_state(const unsigned char *ams)
+{
+  add_response_hdr(ams, 8, ADSERR_NOERR);
+  add_u32(ADSERR_NOERR);
+  add_u16(ADSSTATE_RUN);
+  add_u16(0); /* device state */
+}
+
+/* Read: group, offset, length */
+static void ads_read(const unsigned char *ams,
+                     const unsigned char *data, uint32_t data_len)
+{
+  unsigned char value[ADS_VALUE_MAX];
+  uint32_t result = ADSERR_DEVICE_INVALIDSIZE;
+  uint32_t len = 0;
+
+  if (data_len >= 12) {
+    len = get_u32(&data[8]);
+    result = len > sizeof(value) ? ADSERR_DEVICE_INVALIDSIZE :
+      cmd_EAT_ads_read(get_u32(&data[0]), get_u32(&data[4]), value, len);
+  }
+  if (result != ADSERR_NOERR) {
+    len = 0;
+  }
+  add_response_hdr(ams, 8 + len, ADSERR_NOERR);
+  add_u32(result);
+  add_u32(len);
+  add_to_buf((const char *)value, len);
+}
+
+/* Write: group, offset, length, data */
+static void ads_write(const unsigned char *ams,
+                      const unsigned char *data, uint32_t data_len)
+{
+  uint32_t result = ADSERR_DEVICE_INVALIDSIZE;
+
+  if (data_len >= 12 && get_u32(&data[8]) <= data_len - 12) {
+    result = cmd_EAT_ads_write(get_u32(&data[0]), get_u32(&data[4]),
+                               &data[12], get_u32(&data[8]));
+  }
+  add_response_hdr(ams, 4, ADSERR_NOERR);
+  add_u32(result);
+}
+
+/*
+ * SumRead: num sub requests (group, offset, length) are written,
+ * the num results are read, followed by the data of all of them.
+ * The data of a failed sub request is zero, and has its length.
+ */
+static void ads_sum_read(const unsigned char *ams, uint32_t num,
+                         uint32_t read_len,
+                         const unsigned char *wdata, uint32_t write_len)
+{
+  size_t results_offset;
+  uint64_t sum_len = 0;
+  uint32_t i;
+
+  if (num > write_len / ADS_SUM_HDR_LEN ||
+      write_len != num * ADS_SUM_HDR_LEN) {
+    add_response_hdr(ams, 8, ADSERR_NOERR);
+    add_u32(ADSERR_DEVICE_INVALIDSIZE);
+    add_u32(0);
+    return;
+  }
+  for (i = 0; i < num; i++) {
+    sum_len += get_u32(&wdata[i * ADS_SUM_HDR_LEN + 8]);
+  }
+  sum_len += 4 * num;
+  if (read_len != sum_len || read_len > ADS_SUM_READ_MAX) {
+    add_response_hdr(ams, 8, ADSERR_NOERR);
+    add_u32(ADSERR_DEVICE_INVALIDSIZE);
+    add_u32(0);
+    return;
+  }
+  add_response_hdr(ams, 8 + read_len, ADSERR_NOERR);
+  add_u32(ADSERR_NOERR);
+  add_u32(read_len);
+  /* The results are filled in while the data is added */
+  results_offset = get_buf_len();
+  add_zeros(4 * num);
+  for (i = 0; i < num; i++) {
+    const unsigned char *sub = &wdata[i * ADS_SUM_HDR_LEN];
+    unsigned char value[ADS_VALUE_MAX];
+    uint32_t len = get_u32(&sub[8]);
+    uint32_t result = ADSERR_DEVICE_INVALIDSIZE;
+
+    if (len <= sizeof(value)) {
+      result = cmd_EAT_ads_read(get_u32(&sub[0]), get_u32(&sub[4]),
+                                value, len);
+    }
+    set_u32(results_offset + 4 * i, result);
+    if (result == ADSERR_NOERR) {
+      add_to_buf((const char *)value, len);
+    } else {
+      add_zeros(len);
+    }
+  }
+}
+
+/*
+ * SumWrite: num sub requests (group, offset, length) are written,
+ * followed by the data of all of them; the num results are read.
+ */
+static void ads_sum_write(const unsigned char *ams, uint32_t num,
+                          const unsigned char *wdata, uint32_t write_len)
+{
+  const unsigned char *value;
+  uint32_t i;
+
+  if (num > write_len / ADS_SUM_HDR_LEN) {
+    add_response_hdr(ams, 8, ADSERR_NOERR);
+    add_u32(ADSERR_DEVICE_INVALIDSIZE);
+    add_u32(0);
+    return;
+  }
+  add_response_hdr(ams, 8 + 4 * num, ADSERR_NOERR);
+  add_u32(ADSERR_NOERR);
+  add_u32(4 * num);
+  value = &wdata[num * ADS_SUM_HDR_LEN];
+  for (i = 0; i < num; i++) {
+    const unsigned char *sub = &wdata[i * ADS_SUM_HDR_LEN];
+    uint32_t len = get_u32(&sub[8]);
+    uint32_t result = ADSERR_DEVICE_INVALIDSIZE;
+
+    if (len <= (uint32_t)(&wdata[write_len] - value)) {
+      result = cmd_EAT_ads_write(get_u32(&sub[0]), get_u32(&sub[4]),
+                                 value, len);
+      value += len;
+    } else {
+      value = &wdata[write_len];
+    }
+    add_u32(result);
+  }
+}
+
+/* ReadWrite: group, offset, read length, write length, data */
+static void ads_read_write(const unsigned char *ams,
+                           const unsigned char *data, uint32_t data_len)
+{
+  unsigned char value[ADS_VALUE_MAX];
+  uint32_t group, offset, read_len, write_len;
+  uint32_t result;
+
+  if (data_len < 16 || get_u32(&data[12]) > data_len - 16) {
+    add_response_hdr(ams, 8, ADSERR_NOERR);
+    add_u32(ADSERR_DEVICE_INVALIDSIZE);
+    add_u32(0);
+    return;
+  }
+  group = get_u32(&data[0]);
+  offset = get_u32(&data[4]);
+  read_len = get_u32(&data[8]);
+  write_len = get_u32(&data[12]);
+  if (group == ADSIGRP_SUMUP_READ) {
+    ads_sum_read(ams, offset, read_len, &data[16], write_len);
+    return;
+  }
+  if (group == ADSIGRP_SUMUP_WRITE) {
+    ads_sum_write(ams, offset, &data[16], write_len);
+    return;
+  }
+  /* A parameter: write it, and read it back */
+  result = ADSERR_NOERR;
+  if (write_len) {
+    result = cmd_EAT_ads_write(group, offset, &data[16], write_len);
+  }
+  if (result == ADSERR_NOERR && read_len) {
+    result = read_len > sizeof(value) ? ADSERR_DEVICE_INVALIDSIZE :
+      cmd_EAT_ads_read(group, offset, value, read_len);
+  }
+  if (result != ADSERR_NOERR) {
+    read_len = 0;
+  }
+  add_response_hdr(ams, 8 + read_len, ADSERR_NOERR);
+  add_u32(result);
+  add_u32(read_len);
+  add_to_buf((const char *)value, read_len);
+}
+
+/*****************************************************************************/
+int cmd_ADS_frame_len(const unsigned char *buf, size_t len)
+{
+  uint32_t frame_len;
+
+  if (len < AMS_TCP_HDR_LEN) return 0;
+  frame_len = get_u32(&buf[2]);
+  if (frame_len > ADS_FRAME_MAX - AMS_TCP_HDR_LEN) return -1;
+  return AMS_TCP_HDR_LEN + (int)frame_len;
+}
+
+/*****************************************************************************/
+int cmd_ADS(const unsigned char *buf, size_t len)
+{
+  const unsigned char *ams = &buf[AMS_TCP_HDR_LEN];
+  const unsigned char *data = &ams[AMS_HDR_LEN];
+  uint32_t frame_len;
+  uint32_t data_len;
+  unsigned cmd_id;
+  int total_len = cmd_ADS_frame_len(buf, len);
+
+  if (total_len <= 0) return total_len;
+  if ((size_t)total_len > len) return 0;
+  frame_len = get_u32(&buf[2]);
+  /* Port connect and the like, for a router */
+  if (get_u16(buf)) return AMS_TCP_HDR_LEN + frame_len;
+  if (frame_len < AMS_HDR_LEN) return -1;
+  data_len = get_u32(&ams[AMS_OFF_DATA_LEN]);
+  if (data_len > frame_len - AMS_HDR_LEN) return -1;
+  cmd_id = get_u16(&ams[AMS_OFF_CMD_ID]);
+  LOGINFO6("%s/%s:%d port=%u cmd_id=%u flags=0x%x data_len=%u\n",
+           __FILE__, __FUNCTION__, __LINE__,
+           get_u16(&ams[AMS_OFF_PORT]), cmd_id,
+           get_u16(&ams[AMS_OFF_FLAGS]), (unsigned)data_len);
+
+  if (get_u16(&ams[AMS_OFF_FLAGS]) & AMS_STATE_RESPONSE) {
+    ; /* Not a request */
+  } else if (cmd_id == ADS_CMD_READ_DEVICE_INFO) {
+    ads_read_device_info(ams);
+  } else if (cmd_id == ADS_CMD_READ_STATE) {
+    ads_read_state(ams);
+  } else if (cmd_id != ADS_CMD_READ &&
+             cmd_id != ADS_CMD_WRITE &&
+             cmd_id != ADS_CMD_READ_WRITE) {
+    add_response_hdr(ams, 0, ADSERR_DEVICE_SRVNOTSUPP);
+  } else if (get_u16(&ams[AMS_OFF_PORT]) != ADS_PORT_NC) {
+    add_response_hdr(ams, 0, ADSERR_TARGET_PORT_NOT_FOUND);
+  } else if (cmd_id == ADS_CMD_READ) {
+    ads_read(ams, data, data_len);
+  } else if (cmd_id == ADS_CMD_WRITE) {
+    ads_write(ams, data, data_len);
+  } else {
+    ads_read_write(ams, data, data_len);
+  }
+  return AMS_TCP_HDR_LEN + frame_len;
+}
@@ -0,0 +1,34 @@
+#ifndef CMD_ADS_H
+#define CMD_ADS_H
+
+#include <stddef.h>
+
+/* The AMS/TCP port of TwinCAT, use -p 48898,ADS */
+#define ADS_TCP_PORT 48898
+
+/* Return codes of ADS */
+#define ADSERR_NOERR                 0x000
+#define ADSERR_TARGET_PORT_NOT_FOUND 0x006
+#define ADSERR_DEVICE_SRVNOTSUPP     0x701
+#define ADSERR_DEVICE_INVALIDGRP     0x702
+#define ADSERR_DEVICE_INVALIDOFFSET  0x703
+#define ADSERR_DEVICE_INVALIDACCESS  0x704
+#define ADSERR_DEVICE_INVALIDSIZE    0x705
+#define ADSERR_DEVICE_INVALIDDATA    0x706
+
+/*
+ * The length of the AMS/TCP frame at the start of buf, as told by
+ * its header.  0 if the header is not complete yet,
+ * -1 if the frame is longer than any request which is served
+ */
+int cmd_ADS_frame_len(const unsigned char *buf, size_t len);
+
+/*
+ * Handle the AMS/TCP frame at the start of buf, the response
+ * is added to the cmd_buf.
+ * Returns the length of the frame, 0 if it is not complete yet,
+ * or -1 if the data is not AMS/TCP or too long
+ */
+int cmd_ADS(const unsigned char *buf, size_t len);
+
+#endif /* CMD_ADS_H */
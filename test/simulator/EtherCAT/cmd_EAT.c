@@ -3,11 +3,16 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <stddef.h> /* offsetof */
+#include <stdint.h>
 #include "sock-util.h"
 #include "logerr_info.h"
 #include "cmd_buf.h"
+#include "num_codec.h"
 #include "hw_motor.h"
 #include "cmd_EAT.h"
+#include "cmd_ADS.h"
+#include "cmd.h"
 
 typedef struct
 {
@@ -19,6 +24,7 @@ typedef struct
   double fVelocity;
   double fAcceleration;
   double fDeceleration;
+  double fJerk;
   double homeVeloTowardsHomeSensor;
   double homeVeloFromHomeSensor;
   double manualVelocitySlow;
@@ -60,15 +66,43 @@ typedef struct
   int bBusy;
 } cmd_Motor_status_type;
 
-/* values commanded to the motor */
-static cmd_Motor_cmd_type cmd_Motor_cmd[MAX_AXES];
+/* values commanded to the motor, changed with the axis locked */
+static cmd_Motor_cmd_type *cmd_Motor_cmd;
 
-/* values reported back from the motor */
-static cmd_Motor_status_type cmd_Motor_status[MAX_AXES];
+/*
+ * The fields which the gets read without a lock once the tick runs,
+ * see eat_field_get(): bExecute, bReset, command_no, nCmdData,
+ * fPosition, fAcceleration and fDeceleration
+ */
+#define MOTOR_CMD_GET(axis_no, field) __extension__ ({                  \
+      __typeof__(cmd_Motor_cmd[0].field) v_;                            \
+      __atomic_load(&cmd_Motor_cmd[axis_no].field, &v_, __ATOMIC_RELAXED); \
+      v_; })
+#define MOTOR_CMD_SET(axis_no, field, value) do {                       \
+    __typeof__(cmd_Motor_cmd[0].field) v_ = (value);                    \
+    __atomic_store(&cmd_Motor_cmd[axis_no].field, &v_, __ATOMIC_RELAXED); \
+  } while (0)
+
+static char *init_done;
+
+/* Filled once at startup, read by all the worker threads */
+static void ads_param_hash_init(void);
+static void eat_field_hash_init(void);
+
+int cmd_EAT_alloc_axes(void)
+{
+  ads_param_hash_init();
+  eat_field_hash_init();
+  cmd_Motor_cmd = calloc(MAX_AXES, sizeof(*cmd_Motor_cmd));
+  init_done = calloc(MAX_AXES, sizeof(*init_done));
+  if (!cmd_Motor_cmd || !init_done) {
+    return -1;
+  }
+  return 0;
+}
 
 static void init_axis(int axis_no)
 {
-  static char init_done[MAX_AXES];
   const double MRES = 1;
   const double UREV = 60.0; /* mm/revolution */
   const double SREV = 2000.0; /* ticks/revolution */
@@ -79,13 +113,18 @@ static void init_axis(int axis_no)
   if (axis_no >= MAX_AXES || axis_no < 0) {
     return;
   }
+  if (__atomic_load_n(&init_done[axis_no], __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  hw_motor_lock_axis(axis_no);
   if (!init_done[axis_no]) {
     struct motor_init_values motor_init_values;
     double valueLow = -1.0 * ReverseMRES;
     double valueHigh = 186.0 * ReverseMRES;
     memset(&motor_init_values, 0, sizeof(motor_init_values));
     motor_init_values.ReverseERES = MRES/ERES;
-    motor_init_values.ParkingPos = (100 + axis_no/10.0);
+    /* Between the limit switches, even with many axes */
+    motor_init_values.ParkingPos = (100 + (axis_no % 100)/10.0);
     motor_init_values.MaxHomeVelocityAbs = 5 * ReverseMRES;
     motor_init_values.lowHardLimitPos = valueLow;
     motor_init_values.highHardLimitPos = valueHigh;
@@ -99,7 +138,7 @@ static void init_axis(int axis_no)
     cmd_Motor_cmd[axis_no].maximumVelocity = 50;
     cmd_Motor_cmd[axis_no].homeVeloTowardsHomeSensor = 10;
     cmd_Motor_cmd[axis_no].homeVeloFromHomeSensor = 5;
-    cmd_Motor_cmd[axis_no].fPosition = getMotorPos(axis_no);
+    MOTOR_CMD_SET(axis_no, fPosition, getMotorPos(axis_no));
     cmd_Motor_cmd[axis_no].referenceVelocity = 600;
     cmd_Motor_cmd[axis_no].inTargetPositionMonitorWindow = 0.1;
     cmd_Motor_cmd[axis_no].inTargetPositionMonitorTime = 0.02;
@@ -107,8 +146,9 @@ static void init_axis(int axis_no)
     setMRES_23(axis_no, UREV);
     setMRES_24(axis_no, SREV);
 
-    init_done[axis_no] = 1;
+    __atomic_store_n(&init_done[axis_no], 1, __ATOMIC_RELEASE);
   }
+  hw_motor_unlock_axis(axis_no);
 }
 
 static const char * const ADSPORT_equals_str = "ADSPORT=";
@@ -117,354 +157,1074 @@ static const char * const getAxisDebugInfoData_str = "getAxisDebugInfoData";
 
 static const char *seperator_seperator = ";";
 
-static int motorHandleADS_ADR_getInt(unsigned adsport,
-                                     unsigned indexGroup,
-                                     unsigned indexOffset,
-                                     int *iValue)
-{
-  if (indexGroup >= 0x4000 && indexGroup < 0x5000) {
-    int motor_axis_no = (int)indexGroup - 0x4000;
-    switch(indexOffset)
-      case 0x15:
-      *iValue = cmd_Motor_cmd[motor_axis_no].inTargetPositionMonitorEnabled;
-      return 0; /* Monitor */
-  } else if (indexGroup >= 0x5000 && indexGroup < 0x6000) {
-    int motor_axis_no = (int)indexGroup - 0x5000;
-    switch(indexOffset) {
-      case 0x8:
-        /* Encoder direction axis1: Negative; axis2: positive */
-        *iValue = motor_axis_no & 1 ? 1 : 0;
-        return 0;
-      case 0xB:
-        *iValue = getEnableLowSoftLimit(motor_axis_no);
-        return 0;
-      case 0xC:
-        *iValue = getEnableHighSoftLimit(motor_axis_no);
-        return 0;
-    }
-  } else if (indexGroup >= 0x6000 && indexGroup < 0x7000) {
-    int motor_axis_no = (int)indexGroup - 0x6000;
-    switch(indexOffset) {
-      case 0x10:
-        *iValue = cmd_Motor_cmd[motor_axis_no].positionLagMonitorEnable;
-        return 0;
-    }
-  } else if (indexGroup >= 0x7000 && indexGroup < 0x8000) {
-    int motor_axis_no = (int)indexGroup - 0x7000;
-    switch(indexOffset) {
-      case 0x6:
-        /* Motorr direction axis1: Positive; axis2: negative */
-        *iValue = motor_axis_no & 1 ? 0 : 1;
-        return 0;
-    }
-  } else if (indexGroup == 0x3040010 && indexOffset == 0x80000049) {
-    *iValue = (int)getEncoderPos(1);
-    return 0;
-  } else if (indexGroup == 0x3040010 && indexOffset == 0x8000004F) {
-    *iValue = (int)getEncoderPos(2);
-    return 0;
-  }
-  RETURN_ERROR_OR_DIE(__LINE__, "%s/%s:%d indexGroup=0x%x indexOffset=0x%x",
-                      __FILE__, __FUNCTION__, __LINE__,
-                      indexGroup,
-                      indexOffset);
+/*
+ * The parameters which can be read and written with
+ *   ADSPORT=501/.ADR.16#<indexGroup>,16#<indexOffset>,<len>,<type>?
+ *   ADSPORT=501/.ADR.16#<indexGroup>,16#<indexOffset>,<len>,<type>=<value>
+ * The groups 0x4000..0x7FFF are per axis: the axis number is added
+ * to the base, e.g. 0x5001 is group 0x5000 of axis 1.
+ * type 2 is an int with len 2, type 5 a double with len 8.
+ * A parameter is either a field in cmd_Motor_cmd, or a pair of
+ * get/put functions.
+ */
+#define ADS_TYPE_INT   2
+#define ADS_TYPE_FLOAT 5
+#define ADS_GROUP_PER_AXIS(g) ((g) >= 0x4000 && (g) < 0x8000)
+#define ADS_GROUP_AXIS_MASK   0xFFF
+#define ADS_NO_FIELD ((size_t)-1)
+
+typedef struct ads_param_type {
+  unsigned   indexGroup;  /* The base for the groups per axis */
+  unsigned   indexOffset;
+  unsigned   len_in_PLC;
+  unsigned   type_in_PLC;
+  int        writable;
+  const char *name;
+  size_t     cmd_offset;  /* in cmd_Motor_cmd_type, or ADS_NO_FIELD */
+  double     (*get)(int motor_axis_no);
+  int        (*put)(int motor_axis_no, double value);
+} ads_param_type;
+
+#define ADS_CMD_INT(g, o, field, writable)                               \
+  { g, o, 2, ADS_TYPE_INT, writable, #field,                             \
+    offsetof(cmd_Motor_cmd_type, field), NULL, NULL }
+#define ADS_CMD_FLOAT(g, o, field, writable)                             \
+  { g, o, 8, ADS_TYPE_FLOAT, writable, #field,                           \
+    offsetof(cmd_Motor_cmd_type, field), NULL, NULL }
+#define ADS_FUNC(g, o, len, type, name, get, put)                        \
+  { g, o, len, type, put != NULL, name, ADS_NO_FIELD, get, put }
+
+/* Encoder direction axis1: Negative; axis2: positive */
+static double ads_get_encoder_dir(int motor_axis_no)
+{
+  return motor_axis_no & 1 ? 1 : 0;
+}
+
+/* Motor direction axis1: Positive; axis2: negative */
+static double ads_get_motor_dir(int motor_axis_no)
+{
+  return motor_axis_no & 1 ? 0 : 1;
+}
+
+static double ads_get_enable_low_soft_limit(int motor_axis_no)
+{
+  return getEnableLowSoftLimit(motor_axis_no);
+}
+
+static int ads_put_enable_low_soft_limit(int motor_axis_no, double value)
+{
+  setEnableLowSoftLimit(motor_axis_no, (int)value);
+  return 0;
+}
+
+static double ads_get_enable_high_soft_limit(int motor_axis_no)
+{
+  return getEnableHighSoftLimit(motor_axis_no);
+}
+
+static int ads_put_enable_high_soft_limit(int motor_axis_no, double value)
+{
+  setEnableHighSoftLimit(motor_axis_no, (int)value);
+  return 0;
+}
+
+static int ads_put_low_soft_limit(int motor_axis_no, double value)
+{
+  setLowSoftLimitPos(motor_axis_no, value);
+  return 0;
+}
+
+static int ads_put_high_soft_limit(int motor_axis_no, double value)
+{
+  setHighSoftLimitPos(motor_axis_no, value);
+  return 0;
 }
 
 /*
-  ADSPORT=501/.ADR.16#5001,16#B,2,2=1; #enable low Softlimit
-  ADSPORT=501/.ADR.16#5001,16#C,2,2=1; #enable high Softlimit
-*/
-static int motorHandleADS_ADR_putInt(unsigned adsport,
-                                     unsigned indexGroup,
-                                     unsigned indexOffset,
-                                     int iValue)
-{
-  if (indexGroup >= 0x5000 && indexGroup < 0x6000) {
-    int motor_axis_no = (int)indexGroup - 0x5000;
-    if (indexOffset == 0xB) {
-      setEnableLowSoftLimit(motor_axis_no, iValue);
-      return 0;
-    }
-    if (indexOffset == 0xC) {
-      setEnableHighSoftLimit(motor_axis_no, iValue);
-      return 0;
+ * The raw encoder values of the first two axes.  Their index group
+ * 0x3040010 is not per axis, so the axis of the request is ignored
+ */
+static double ads_get_encoder_axis(int cmd_axis_no)
+{
+  int motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
+  double value;
+  hw_motor_lock_axis(motor_axis_no);
+  value = (int)getEncoderPos(motor_axis_no);
+  hw_motor_unlock_axis(motor_axis_no);
+  return value;
+}
+
+static double ads_get_encoder_axis_1(int motor_axis_no)
+{
+  (void)motor_axis_no;
+  return ads_get_encoder_axis(1);
+}
+
+static double ads_get_encoder_axis_2(int motor_axis_no)
+{
+  (void)motor_axis_no;
+  return ads_get_encoder_axis(2);
+}
+
+static const ads_param_type ads_params[] = {
+  ADS_CMD_FLOAT(0x4000, 0x6,   homeVeloTowardsHomeSensor, 1),
+  ADS_CMD_FLOAT(0x4000, 0x7,   homeVeloFromHomeSensor, 1),
+  ADS_CMD_FLOAT(0x4000, 0x8,   manualVelocitySlow, 1),
+  ADS_CMD_FLOAT(0x4000, 0x9,   manualVelocityFast, 1),
+  ADS_CMD_INT  (0x4000, 0x15,  inTargetPositionMonitorEnabled, 1),
+  ADS_CMD_FLOAT(0x4000, 0x16,  inTargetPositionMonitorWindow, 0),
+  ADS_CMD_FLOAT(0x4000, 0x17,  inTargetPositionMonitorTime, 0),
+  ADS_CMD_FLOAT(0x4000, 0x27,  maximumVelocity, 1),
+  ADS_CMD_FLOAT(0x4000, 0x101, defaultAcceleration, 1),
+  ADS_CMD_FLOAT(0x4000, 0x104, deadTimeCompensation, 1),
+  ADS_FUNC(0x5000, 0x8,  2, ADS_TYPE_INT, "encoderDirection",
+           ads_get_encoder_dir, NULL),
+  ADS_FUNC(0x5000, 0xB,  2, ADS_TYPE_INT, "enableLowSoftLimit",
+           ads_get_enable_low_soft_limit, ads_put_enable_low_soft_limit),
+  ADS_FUNC(0x5000, 0xC,  2, ADS_TYPE_INT, "enableHighSoftLimit",
+           ads_get_enable_high_soft_limit, ads_put_enable_high_soft_limit),
+  ADS_FUNC(0x5000, 0xD,  8, ADS_TYPE_FLOAT, "lowSoftLimit",
+           getLowSoftLimitPos, ads_put_low_soft_limit),
+  ADS_FUNC(0x5000, 0xE,  8, ADS_TYPE_FLOAT, "highSoftLimit",
+           getHighSoftLimitPos, ads_put_high_soft_limit),
+  ADS_FUNC(0x5000, 0x23, 8, ADS_TYPE_FLOAT, "scaleNumerator",
+           getMRES_23, setMRES_23),
+  ADS_FUNC(0x5000, 0x24, 8, ADS_TYPE_FLOAT, "scaleDenominator",
+           getMRES_24, setMRES_24),
+  ADS_CMD_INT  (0x6000, 0x10,  positionLagMonitorEnable, 1),
+  ADS_CMD_FLOAT(0x6000, 0x12,  positionLagMonitoringValue, 1),
+  ADS_CMD_FLOAT(0x6000, 0x13,  positionLagFilterTime, 1),
+  ADS_FUNC(0x7000, 0x6,  2, ADS_TYPE_INT, "motorDirection",
+           ads_get_motor_dir, NULL),
+  ADS_CMD_FLOAT(0x7000, 0x101, referenceVelocity, 1),
+  ADS_FUNC(0x3040010, 0x80000049, 2, ADS_TYPE_INT, "encoderAxis1",
+           ads_get_encoder_axis_1, NULL),
+  ADS_FUNC(0x3040010, 0x8000004F, 2, ADS_TYPE_INT, "encoderAxis2",
+           ads_get_encoder_axis_2, NULL),
+};
+
+#define NUM_ADS_PARAMS (sizeof(ads_params) / sizeof(ads_params[0]))
+/* Open addressing, a power of 2 and at least twice NUM_ADS_PARAMS */
+#define ADS_PARAM_HASH_LEN 64
+
+/* Index + 1 into ads_params, 0 is an empty slot */
+static unsigned char ads_param_hash[ADS_PARAM_HASH_LEN];
+
+static unsigned ads_param_hash_key(unsigned indexGroup, unsigned indexOffset)
+{
+  unsigned h = indexGroup * 2654435761u ^ indexOffset;
+  h ^= h >> 16;
+  h *= 0x45d9f3bu;
+  h ^= h >> 16;
+  return h;
+}
+
+static void ads_param_hash_init(void)
+{
+  unsigned i;
+  for (i = 0; i < NUM_ADS_PARAMS; i++) {
+    unsigned h = ads_param_hash_key(ads_params[i].indexGroup,
+                                    ads_params[i].indexOffset);
+    while (ads_param_hash[h & (ADS_PARAM_HASH_LEN - 1)]) {
+      h++;
     }
+    ads_param_hash[h & (ADS_PARAM_HASH_LEN - 1)] = (unsigned char)(i + 1);
   }
-  if (indexGroup >= 0x4000 && indexGroup < 0x5000) {
-    int motor_axis_no = (int)indexGroup - 0x4000;
-    if (indexOffset == 0x15) {
-      cmd_Motor_cmd[motor_axis_no].inTargetPositionMonitorEnabled = iValue;
-      return 0;
+}
+
+/*
+ * Find the parameter, and the axis for the groups per axis.
+ * Returns NULL for an unknown address or an invalid axis
+ */
+static const ads_param_type *ads_param_find(unsigned indexGroup,
+                                            unsigned indexOffset,
+                                            int *motor_axis_no)
+{
+  unsigned h;
+  unsigned idx;
+
+  *motor_axis_no = 0;
+  if (ADS_GROUP_PER_AXIS(indexGroup)) {
+    int axis_no = cmd_axis_no_to_hw((int)(indexGroup & ADS_GROUP_AXIS_MASK));
+    init_axis(axis_no);
+    if (axis_no <= 0 || axis_no >= MAX_AXES) {
+      return NULL;
     }
-  } else if (indexGroup >= 0x6000 && indexGroup < 0x7000) {
-    int motor_axis_no = (int)indexGroup - 0x6000;
-    switch(indexOffset) {
-      case 0x10:
-        cmd_Motor_cmd[motor_axis_no].positionLagMonitorEnable = iValue;
-        return 0;
+    *motor_axis_no = axis_no;
+    indexGroup &= ~ADS_GROUP_AXIS_MASK;
+  }
+  h = ads_param_hash_key(indexGroup, indexOffset);
+  while ((idx = ads_param_hash[h & (ADS_PARAM_HASH_LEN - 1)])) {
+    const ads_param_type *param = &ads_params[idx - 1];
+    if (param->indexGroup == indexGroup &&
+        param->indexOffset == indexOffset) {
+      return param;
     }
+    h++;
   }
+  return NULL;
+}
 
-  RETURN_ERROR_OR_DIE(__LINE__, "%s/%s:%d indexGroup=0x%x indexOffset=0x%x",
-               __FILE__, __FUNCTION__, __LINE__,
-               indexGroup,
-               indexOffset);
-}
-
-
-static int motorHandleADS_ADR_getFloat(unsigned adsport,
-                                       unsigned indexGroup,
-                                       unsigned indexOffset,
-                                       double *fValue)
-{
-  if (indexGroup >= 0x4000 && indexGroup < 0x5000) {
-    int motor_axis_no = (int)indexGroup - 0x4000;
-    switch(indexOffset) {
-    case 0x6:
-      *fValue = cmd_Motor_cmd[motor_axis_no].homeVeloTowardsHomeSensor;
-      return 0;
-    case 0x7:
-      *fValue = cmd_Motor_cmd[motor_axis_no].homeVeloFromHomeSensor;
-      return 0;
-    case 0x8:
-      *fValue = cmd_Motor_cmd[motor_axis_no].manualVelocitySlow;
-      return 0;
-    case 0x9:
-      *fValue = cmd_Motor_cmd[motor_axis_no].manualVelocityFast;
-      return 0;
-    case 0x16:
-      *fValue = cmd_Motor_cmd[motor_axis_no].inTargetPositionMonitorWindow;
-      return 0;
-    case 0x17:
-      *fValue = cmd_Motor_cmd[motor_axis_no].inTargetPositionMonitorTime;
-      return 0;
-    case 0x27:
-      *fValue = cmd_Motor_cmd[motor_axis_no].maximumVelocity;
-      return 0;
-    case 0x101:
-      *fValue = cmd_Motor_cmd[motor_axis_no].defaultAcceleration;
-      return 0;
-    case 0x104:
-      *fValue = cmd_Motor_cmd[motor_axis_no].deadTimeCompensation;
-      return 0;
-    }
-  } else if (indexGroup >= 0x5000 && indexGroup < 0x6000) {
-    int motor_axis_no = (int)indexGroup - 0x5000;
-    switch(indexOffset) {
-      case 0xD:
-        *fValue = getLowSoftLimitPos(motor_axis_no);
-        return 0;
-      case 0xE:
-        *fValue = getHighSoftLimitPos(motor_axis_no);
-        return 0;
-      case 0x23:
-        *fValue = getMRES_23(motor_axis_no);
-        return 0;
-      case 0x24:
-        *fValue = getMRES_24(motor_axis_no);
-        return 0;
-    }
-  } else if (indexGroup >= 0x6000 && indexGroup < 0x7000) {
-    int motor_axis_no = (int)indexGroup - 0x6000;
-    switch(indexOffset) {
-      case 0x12:
-        *fValue = cmd_Motor_cmd[motor_axis_no].positionLagMonitoringValue;
-        return 0;
-      case 0x13:
-        *fValue = cmd_Motor_cmd[motor_axis_no].positionLagFilterTime;
-        return 0;
-    }
-  } else if (indexGroup >= 0x7000 && indexGroup < 0x8000) {
-    int motor_axis_no = (int)indexGroup - 0x7000;
-    switch(indexOffset) {
-    case 0x101:
-      *fValue = cmd_Motor_cmd[motor_axis_no].referenceVelocity;
-      return 0;
+/* motor_axis_no is 0 for the groups which are not per axis */
+static double ads_param_get(const ads_param_type *param, int motor_axis_no)
+{
+  double value;
+  hw_motor_lock_axis(motor_axis_no);
+  if (param->cmd_offset != ADS_NO_FIELD) {
+    char *field = (char *)&cmd_Motor_cmd[motor_axis_no] + param->cmd_offset;
+    if (param->type_in_PLC == ADS_TYPE_INT) {
+      value = *(int *)(void *)field;
+    } else {
+      value = *(double *)(void *)field;
     }
+  } else {
+    value = param->get(motor_axis_no);
+  }
+  hw_motor_unlock_axis(motor_axis_no);
+  return value;
+}
 
+static int ads_param_put(const ads_param_type *param, int motor_axis_no,
+                         double value)
+{
+  int ret = 0;
+  hw_motor_lock_axis(motor_axis_no);
+  if (param->cmd_offset != ADS_NO_FIELD) {
+    char *field = (char *)&cmd_Motor_cmd[motor_axis_no] + param->cmd_offset;
+    if (param->type_in_PLC == ADS_TYPE_INT) {
+      *(int *)(void *)field = (int)value;
+    } else {
+      *(double *)(void *)field = value;
+    }
+  } else {
+    ret = param->put(motor_axis_no, value);
   }
-  return -1;
+  hw_motor_unlock_axis(motor_axis_no);
+  return ret;
 }
 
 /*
-  ADSPORT=501/.ADR.16#5001,16#D,8,5=-13.5; #low Softlimit
-  ADSPORT=501/.ADR.16#5001,16#E,8,5=140.0; #high Softlimit
+  ADSPORT=501/.ADR.list?
+  All parameters, separated by ' ': 16#5000,16#D,8,5,rw,lowSoftLimit
 */
-static int motorHandleADS_ADR_putFloat(unsigned adsport,
-                                       unsigned indexGroup,
-                                       unsigned indexOffset,
-                                       double fValue)
-{
-  if (indexGroup >= 0x4000 && indexGroup < 0x5000) {
-    int motor_axis_no = (int)indexGroup - 0x4000;
-    switch(indexOffset) {
-    case 0x6:
-      cmd_Motor_cmd[motor_axis_no].homeVeloTowardsHomeSensor = fValue;
-      return 0;
-    case 0x7:
-      cmd_Motor_cmd[motor_axis_no].homeVeloFromHomeSensor = fValue;
-      return 0;
-    case 0x8:
-      cmd_Motor_cmd[motor_axis_no].manualVelocitySlow = fValue;
-      return 0;
-    case 0x9:
-      cmd_Motor_cmd[motor_axis_no].manualVelocityFast = fValue;
-      return 0;
-    case 0x27:
-      cmd_Motor_cmd[motor_axis_no].maximumVelocity = fValue;
-      return 0;
-    case 0x101:
-      cmd_Motor_cmd[motor_axis_no].defaultAcceleration = fValue;
-      return 0;
-    case 0x104:
-      cmd_Motor_cmd[motor_axis_no].deadTimeCompensation = fValue;
-      return 0;
-    }
-  } else if (indexGroup >= 0x5000 && indexGroup < 0x6000) {
-    int motor_axis_no = (int)indexGroup - 0x5000;
-    switch(indexOffset) {
-      case 0xD:
-        setLowSoftLimitPos(motor_axis_no, fValue);
-        return 0;
-      case 0xE:
-        setHighSoftLimitPos(motor_axis_no, fValue);
-        return 0;
-      case 0x23:
-        return setMRES_23(motor_axis_no, fValue);
-      case 0x24:
-        return setMRES_24(motor_axis_no, fValue);
-    }
-  } else if (indexGroup >= 0x6000 && indexGroup < 0x7000) {
-    int motor_axis_no = (int)indexGroup - 0x6000;
-    (void)motor_axis_no;
-    switch(indexOffset) {
-      case 0x12:
-        cmd_Motor_cmd[motor_axis_no].positionLagMonitoringValue = fValue;
-        return 0;
-      case 0x13:
-        cmd_Motor_cmd[motor_axis_no].positionLagFilterTime = fValue;
-        return 0;
-    }
-  } else if (indexGroup >= 0x7000 && indexGroup < 0x8000) {
-    int motor_axis_no = (int)indexGroup - 0x7000;
-    switch(indexOffset) {
-    (void)motor_axis_no;
-    case 0x101:
-      cmd_Motor_cmd[motor_axis_no].referenceVelocity = fValue ;
-      return 0;
-    }
+static void motorHandleADS_ADR_list(void)
+{
+  unsigned i;
+  for (i = 0; i < NUM_ADS_PARAMS; i++) {
+    const ads_param_type *param = &ads_params[i];
+    cmd_buf_printf("%s16#%X,16#%X,%u,%u,%s,%s",
+                   i ? " " : "",
+                   param->indexGroup,
+                   param->indexOffset,
+                   param->len_in_PLC,
+                   param->type_in_PLC,
+                   param->writable ? "rw" : "r",
+                   param->name);
   }
-  return __LINE__;
 }
 
+/*****************************************************************************/
+/* The same parameters for binary ADS, an int is an INT16, little endian */
+unsigned cmd_EAT_ads_read(unsigned indexGroup, unsigned indexOffset,
+                          unsigned char *data, unsigned len)
+{
+  const ads_param_type *param;
+  int motor_axis_no;
+  double fValue;
+  uint64_t raw;
+  unsigned i;
+
+  param = ads_param_find(indexGroup, indexOffset, &motor_axis_no);
+  if (!param) return ADSERR_DEVICE_INVALIDOFFSET;
+  if (param->len_in_PLC != len) return ADSERR_DEVICE_INVALIDSIZE;
+  fValue = ads_param_get(param, motor_axis_no);
+  if (param->type_in_PLC == ADS_TYPE_INT) {
+    raw = (uint16_t)(int16_t)(int)fValue;
+  } else {
+    memcpy(&raw, &fValue, sizeof(raw));
+  }
+  for (i = 0; i < len; i++) {
+    data[i] = (unsigned char)(raw >> (8 * i));
+  }
+  return ADSERR_NOERR;
+}
+
+unsigned cmd_EAT_ads_write(unsigned indexGroup, unsigned indexOffset,
+                           const unsigned char *data, unsigned len)
+{
+  const ads_param_type *param;
+  int motor_axis_no;
+  double fValue;
+  uint64_t raw = 0;
+  unsigned i;
+
+  param = ads_param_find(indexGroup, indexOffset, &motor_axis_no);
+  if (!param) return ADSERR_DEVICE_INVALIDOFFSET;
+  if (!param->writable) return ADSERR_DEVICE_INVALIDACCESS;
+  if (param->len_in_PLC != len) return ADSERR_DEVICE_INVALIDSIZE;
+  for (i = 0; i < len; i++) {
+    raw |= (uint64_t)data[i] << (8 * i);
+  }
+  if (param->type_in_PLC == ADS_TYPE_INT) {
+    fValue = (int16_t)(uint16_t)raw;
+  } else {
+    memcpy(&fValue, &raw, sizeof(fValue));
+  }
+  if (ads_param_put(param, motor_axis_no, fValue)) {
+    return ADSERR_DEVICE_INVALIDDATA;
+  }
+  return ADSERR_NOERR;
+}
 
 /*
-  ADSPORT=501/.ADR.16#5001,16#B,2,2=1;
+  One parameter: 16#5001,16#B,2,2=1 or 16#5001,16#B,2,2?
+  A value which is read is added to the output.
+  Returns -1 if a value was read, 0 if written, or the line of the error
 */
-static int motorHandleADS_ADR(const char *arg)
+static int motorHandleADS_ADR_param(const char *arg)
 {
+  const ads_param_type *param;
   const char *myarg_1 = NULL;
-  unsigned adsport = 0;
   unsigned indexGroup = 0;
   unsigned indexOffset = 0;
   unsigned len_in_PLC = 0;
   unsigned type_in_PLC = 0;
+  int motor_axis_no;
   int nvals;
-  nvals = sscanf(arg, "%u/.ADR.16#%x,16#%x,%u,%u=",
-                 &adsport,
+  nvals = sscanf(arg, "16#%x,16#%x,%u,%u",
                  &indexGroup,
                  &indexOffset,
                  &len_in_PLC,
                  &type_in_PLC);
   LOGINFO6("%s/%s:%d "
-           "nvals=%d adsport=%u indexGroup=0x%x indexOffset=0x%x len_in_PLC=%u type_in_PLC=%u\n",
+           "nvals=%d indexGroup=0x%x indexOffset=0x%x len_in_PLC=%u type_in_PLC=%u\n",
            __FILE__, __FUNCTION__, __LINE__,
            nvals,
-           adsport,
            indexGroup,
            indexOffset,
            len_in_PLC,
            type_in_PLC);
 
-  if (nvals != 5) return __LINE__;
-  if (adsport != 501) return __LINE__;
+  if (nvals != 4) return __LINE__;
+
+  param = ads_param_find(indexGroup, indexOffset, &motor_axis_no);
+  if (!param) return __LINE__;
+  if (param->type_in_PLC != type_in_PLC) return __LINE__;
+  if (param->len_in_PLC != len_in_PLC) return __LINE__;
 
   myarg_1 = strchr(arg, '=');
   if (myarg_1) {
+    double fValue;
     myarg_1++; /* Jump over '=' */
-    switch (type_in_PLC) {
-      case 5: {
-        double fValue;
-        if (len_in_PLC != 8) return __LINE__;
-        nvals = sscanf(myarg_1, "%lf", &fValue);
-        if (nvals != 1) return __LINE__;
-        return motorHandleADS_ADR_putFloat(adsport,
-                                        indexGroup,
-                                        indexOffset,
-                                        fValue);
-      }
-        break;
-      case 2: {
-        int iValue;
-        if (len_in_PLC != 2) return __LINE__;
-        nvals = sscanf(myarg_1, "%d", &iValue);
-        if (nvals != 1) return __LINE__;
-        return motorHandleADS_ADR_putInt(adsport,
-                                      indexGroup,
-                                      indexOffset,
-                                      iValue);
-      }
-        break;
-      default:
-        return __LINE__;
+    if (!param->writable) return __LINE__;
+    if (type_in_PLC == ADS_TYPE_INT) {
+      int iValue;
+      nvals = sscanf(myarg_1, "%d", &iValue);
+      fValue = iValue;
+    } else {
+      nvals = num_parse_double(myarg_1, &fValue);
     }
+    if (nvals != 1) return __LINE__;
+    return ads_param_put(param, motor_axis_no, fValue);
   }
   myarg_1 = strchr(arg, '?');
   if (myarg_1) {
-    int res;
-    myarg_1++; /* Jump over '?' */
-    switch (type_in_PLC) {
-      case 5: {
-        double fValue;
-        if (len_in_PLC != 8) return __LINE__;
-        res = motorHandleADS_ADR_getFloat(adsport,
-                                          indexGroup,
-                                          indexOffset,
-                                          &fValue);
-        if (res) return res;
-        cmd_buf_printf("%g", fValue);
-        return -1;
+    double fValue = ads_param_get(param, motor_axis_no);
+    if (type_in_PLC == ADS_TYPE_INT) {
+      cmd_buf_printf("%d", (int)fValue);
+    } else {
+      cmd_buf_add_double(fValue);
+    }
+    return -1;
+  }
+  return __LINE__;
+}
+
+/*
+  ADSPORT=501/.ADR.sum=16#5001,16#D,8,5=14|16#5001,16#E,8,5=169|16#4001,16#27,8,5?
+  Many parameters in one round trip, separated by '|'.
+  The answers are separated by '|' as well: OK, the value, or Error:<n>
+*/
+static void motorHandleADS_ADR_sum(const char *arg)
+{
+  char param_buf[80];
+
+  for (;;) {
+    size_t len = strcspn(arg, "|");
+    int err_code = __LINE__;
+    if (len < sizeof(param_buf)) {
+      /* The '?' or '=' must be found in this parameter only */
+      memcpy(param_buf, arg, len);
+      param_buf[len] = '\0';
+      err_code = motorHandleADS_ADR_param(param_buf);
+    }
+    if (!err_code) {
+      cmd_buf_printf("OK");
+    } else if (err_code > 0) {
+      cmd_buf_printf("Error:%d", err_code);
+    }
+    if (!arg[len]) {
+      break;
+    }
+    add_to_buf("|", 1);
+    arg += len + 1;
+  }
+}
+
+/*
+  ADSPORT=501/.ADR.16#5001,16#B,2,2=1;
+*/
+static int motorHandleADS_ADR(const char *arg)
+{
+  static const char ADR_dot_str[] = "/.ADR.";
+  static const char list_str[] = "list?";
+  static const char sum_equals_str[] = "sum=";
+  const char *myarg_1;
+  unsigned adsport = 0;
+  int nvals;
+
+  nvals = sscanf(arg, "%u", &adsport);
+  if (nvals != 1 || adsport != 501) return __LINE__;
+  myarg_1 = strchr(arg, '/');
+  if (!myarg_1 || strncmp(myarg_1, ADR_dot_str, sizeof(ADR_dot_str) - 1)) {
+    return __LINE__;
+  }
+  myarg_1 += sizeof(ADR_dot_str) - 1;
+  if (!strcmp(myarg_1, list_str)) {
+    motorHandleADS_ADR_list();
+    return -1;
+  }
+  if (!strncmp(myarg_1, sum_equals_str, sizeof(sum_equals_str) - 1)) {
+    motorHandleADS_ADR_sum(myarg_1 + sizeof(sum_equals_str) - 1);
+    return -1;
+  }
+  return motorHandleADS_ADR_param(myarg_1);
+}
+
+
+/*
+ * The commands for the fields of an axis, like "Main.M1.bBusy?" or
+ * "Main.M1.fPosition=100", are looked up in a table.
+ * The key is the name of the field and the '?' or '='.
+ */
+typedef struct eat_ctx_type {
+  const char *myarg; /* The whole argument, for error messages */
+  int        cmd_axis_no;
+  int        motor_axis_no;
+} eat_ctx_type;
+
+typedef struct eat_field_type {
+  const char *name;
+  char       suffix; /* '?' or '=' */
+  void       (*get)(const eat_ctx_type *ctx);
+  void       (*put_int)(const eat_ctx_type *ctx, int iValue);
+  void       (*put_float)(const eat_ctx_type *ctx, double fValue);
+} eat_field_type;
+
+/* "get" commands */
+static void eat_get_bBusy(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", isMotorMoving(ctx->motor_axis_no));
+}
+
+static void eat_get_bError(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", get_bError(ctx->motor_axis_no));
+}
+
+/* bEnable? bEnabled? Both are the same in the simulator */
+static void eat_get_bEnabled(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d",getAmplifierOn(ctx->motor_axis_no));
+}
+
+static void eat_get_bExecute(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", MOTOR_CMD_GET(ctx->motor_axis_no, bExecute));
+}
+
+static void eat_get_bHomeSensor(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", getAxisHome(ctx->motor_axis_no));
+}
+
+static void eat_get_bLimitBwd(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", getNegLimitSwitch(ctx->motor_axis_no) ? 0 : 1);
+}
+
+static void eat_get_bLimitFwd(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", getPosLimitSwitch(ctx->motor_axis_no) ? 0 : 1);
+}
+
+static void eat_get_bHomed(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", getAxisHomed(ctx->motor_axis_no) ? 1 : 0);
+}
+
+static void eat_get_bReset(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", MOTOR_CMD_GET(ctx->motor_axis_no, bReset));
+}
+
+static void eat_get_fAcceleration(const eat_ctx_type *ctx)
+{
+  cmd_buf_add_double(MOTOR_CMD_GET(ctx->motor_axis_no, fAcceleration));
+}
+
+static void eat_get_fActPosition(const eat_ctx_type *ctx)
+{
+  cmd_buf_add_double(getMotorPos(ctx->motor_axis_no));
+}
+
+static void eat_get_fActVelocity(const eat_ctx_type *ctx)
+{
+  cmd_buf_add_double(getMotorVelocity(ctx->motor_axis_no));
+}
+
+static void eat_get_fPosition(const eat_ctx_type *ctx)
+{
+  /* The "set" value */
+  cmd_buf_add_double(MOTOR_CMD_GET(ctx->motor_axis_no, fPosition));
+}
+
+static void eat_get_nCommand(const eat_ctx_type *ctx)
+{
+  cmd_buf_printf("%d", MOTOR_CMD_GET(ctx->motor_axis_no, command_no));
+}
+
+static void eat_get_nMotionAxisID(const eat_ctx_type *ctx)
+{
+  /* The NC axis id is the same as motion axis id */
+  cmd_buf_printf("%d", ctx->cmd_axis_no);
+}
+
+/*
+ * The values are collected first, with the axis locked if needed,
+ * and formatted after that
+ */
+static void eat_get_stAxisStatus(const eat_ctx_type *ctx)
+{
+  int motor_axis_no = ctx->motor_axis_no;
+  int ticking = hw_motor_ticking();
+  cmd_Motor_status_type st;
+  motor_status_type status;
+  double fAcceleration;
+  double fDeceleration;
+  int bJogFwd = 0;
+  int bJogBwd = 0;
+  double fOverride = 0;
+
+  memset(&st, 0, sizeof(st));
+  if (!ticking) {
+    hw_motor_lock_axis(motor_axis_no);
+  }
+  getMotorStatus(motor_axis_no, &status);
+  st.bExecute = MOTOR_CMD_GET(motor_axis_no, bExecute);
+  st.nCmdData = MOTOR_CMD_GET(motor_axis_no, nCmdData);
+  fAcceleration = MOTOR_CMD_GET(motor_axis_no, fAcceleration);
+  fDeceleration = MOTOR_CMD_GET(motor_axis_no, fDeceleration);
+  if (!ticking) {
+    hw_motor_unlock_axis(motor_axis_no);
+  }
+  st.fActPostion = status.MotorPos;
+  st.bEnable = status.amplifierOn;
+  st.bEnabled = status.amplifierOn;
+  st.bLimitFwd = status.posLimitSwitch ? 0 : 1;
+  st.bLimitBwd = status.negLimitSwitch ? 0 : 1;
+  st.bHomeSensor = status.homeSwitch;
+  st.bError = status.nErrorId ? 1 : 0;
+  st.nErrorId = status.nErrorId;
+  st.fActVelocity = status.velocity;
+  st.bHomed = status.homed;
+  st.bBusy = status.moving;
+
+  /* The doubles are formatted separately, %g has only 6 digits */
+  cmd_buf_printf("Main.M%d.stAxisStatus="
+                 "%d,%d,%d,%u,%u,",
+                 ctx->cmd_axis_no,
+                 st.bEnable,                                     /*  1 */
+                 st.bReset,                                      /*  2 */
+                 st.bExecute,                                    /*  3 */
+                 st.nCommand,                                    /*  4 */
+                 st.nCmdData);                                   /*  5 */
+  cmd_buf_add_double(st.fVelocity);                               /*  6 */
+  add_to_buf(",", 1);
+  cmd_buf_add_double(st.fPosition);                               /*  7 */
+  add_to_buf(",", 1);
+  cmd_buf_add_double(fAcceleration);                              /*  8 */
+  add_to_buf(",", 1);
+  cmd_buf_add_double(fDeceleration);                              /*  9 */
+  cmd_buf_printf(",%d,%d,%d,%d,",
+                 bJogFwd,                                        /* 10 */
+                 bJogBwd,                                        /* 11 */
+                 st.bLimitFwd,                                   /* 12 */
+                 st.bLimitBwd);                                  /* 13 */
+  cmd_buf_add_double(fOverride);                                  /* 14 */
+  cmd_buf_printf(",%d,%d,%d,%u,",
+                 st.bHomeSensor,                                 /* 15 */
+                 st.bEnabled,                                    /* 16 */
+                 st.bError,                                      /* 17 */
+                 st.nErrorId);                                   /* 18 */
+  cmd_buf_add_double(st.fActVelocity);                            /* 19 */
+  add_to_buf(",", 1);
+  cmd_buf_add_double(st.fActPostion);                             /* 20 */
+  add_to_buf(",", 1);
+  cmd_buf_add_double(st.fActDiff);                                /* 21 */
+  cmd_buf_printf(",%d,%d",
+                 st.bHomed,                                      /* 22 */
+                 st.bBusy);                                      /* 23 */
+}
+
+/*
+ * "M*.stAxisStatus?" or "M1-4.stAxisStatus?": the status of many axes
+ * in one round trip.  The answers are separated by ';', as if the
+ * axes were asked one by one.
+ * Returns 0 if myarg_1 does not start with "M*." or "M<n>-<m>.",
+ * -1 if the field or the range is not valid
+ */
+static int motorHandleAxisList(const char *myarg, const char *myarg_1)
+{
+  static const char stAxisStatusQ_str[] = "stAxisStatus?";
+  int num_axes = cmd_port_num_axes();
+  int first_axis = 1;
+  int last_axis;
+  int cmd_axis_no;
+  const char *field;
+
+  if (!num_axes) {
+    num_axes = MAX_AXES - 1;
+  }
+  last_axis = num_axes;
+
+  if (myarg_1[0] != 'M') return 0;
+  if (myarg_1[1] == '*') {
+    field = &myarg_1[2];
+  } else {
+    char *end;
+    first_axis = (int)strtol(&myarg_1[1], &end, 10);
+    if (end == &myarg_1[1] || *end != '-') return 0;
+    field = end + 1;
+    last_axis = (int)strtol(field, &end, 10);
+    if (end == field) return 0;
+    field = end;
+  }
+  if (*field != '.') return 0;
+  field++;
+
+  if (strcmp(field, stAxisStatusQ_str) ||
+      first_axis < 1 || last_axis > num_axes ||
+      first_axis > last_axis) {
+    return -1;
+  }
+  for (cmd_axis_no = first_axis; cmd_axis_no <= last_axis; cmd_axis_no++) {
+    eat_ctx_type ctx;
+    ctx.myarg = myarg;
+    ctx.cmd_axis_no = cmd_axis_no;
+    ctx.motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
+    init_axis(ctx.motor_axis_no);
+    if (ctx.motor_axis_no <= 0 || ctx.motor_axis_no >= MAX_AXES) {
+      /* A port range beyond the simulator */
+      break;
+    }
+    if (cmd_axis_no != first_axis) {
+      add_to_buf(seperator_seperator, 1);
+    }
+    eat_get_stAxisStatus(&ctx);
+    cmd_send_part();
+  }
+  return 1;
+}
+
+static void eat_get_sErrorMessage(const eat_ctx_type *ctx)
+{
+  char buf[32]; /* 9 should be OK */
+  int nErrorId = get_nErrorId(ctx->motor_axis_no);
+  snprintf(buf, sizeof(buf), "%x", nErrorId);
+  cmd_buf_printf("%s", buf);
+}
+
+/* "set" commands */
+static void eat_put_nCommand(const eat_ctx_type *ctx, int iValue)
+{
+  MOTOR_CMD_SET(ctx->motor_axis_no, command_no, iValue);
+  cmd_buf_printf("OK");
+}
+
+static void eat_put_nCmdData(const eat_ctx_type *ctx, int iValue)
+{
+  MOTOR_CMD_SET(ctx->motor_axis_no, nCmdData, iValue);
+  cmd_buf_printf("OK");
+}
+
+static void eat_put_fPosition(const eat_ctx_type *ctx, double fValue)
+{
+  MOTOR_CMD_SET(ctx->motor_axis_no, fPosition, fValue);
+  cmd_buf_printf("OK");
+}
+
+static void eat_put_fHomePosition(const eat_ctx_type *ctx, double fValue)
+{
+  /* Accepted, but not used */
+  (void)ctx;
+  (void)fValue;
+  cmd_buf_printf("OK");
+}
+
+static void eat_put_fVelocity(const eat_ctx_type *ctx, double fValue)
+{
+  cmd_Motor_cmd[ctx->motor_axis_no].fVelocity = fValue;
+  cmd_buf_printf("OK");
+}
+
+static void eat_put_fAcceleration(const eat_ctx_type *ctx, double fValue)
+{
+  MOTOR_CMD_SET(ctx->motor_axis_no, fAcceleration, fValue);
+  cmd_buf_printf("OK");
+}
+
+static void eat_put_fDeceleration(const eat_ctx_type *ctx, double fValue)
+{
+  MOTOR_CMD_SET(ctx->motor_axis_no, fDeceleration, fValue);
+  setMotorProfile(ctx->motor_axis_no, fValue,
+                  cmd_Motor_cmd[ctx->motor_axis_no].fJerk);
+  cmd_buf_printf("OK");
+}
+
+/* 0 is a trapezoid, otherwise an S-curve */
+static void eat_put_fJerk(const eat_ctx_type *ctx, double fValue)
+{
+  cmd_Motor_cmd[ctx->motor_axis_no].fJerk = fValue;
+  setMotorProfile(ctx->motor_axis_no,
+                  cmd_Motor_cmd[ctx->motor_axis_no].fDeceleration, fValue);
+  cmd_buf_printf("OK");
+}
+
+static void eat_put_bEnable(const eat_ctx_type *ctx, int iValue)
+{
+  int motor_axis_no = ctx->motor_axis_no;
+  int amplifierLockedToBeOff = getAmplifierLockedToBeOff(motor_axis_no);
+  if (amplifierLockedToBeOff) {
+    setAmplifierPercent(motor_axis_no, 0);
+    if (amplifierLockedToBeOff == AMPLIFIER_LOCKED_TO_BE_OFF_LOUD) {
+      cmd_buf_printf("Amplifier locked");
+      return;
+    }
+    iValue = 0;
+  }
+  setAmplifierPercent(motor_axis_no, iValue ? 100 : 0);
+  cmd_buf_printf("OK");
+}
+
+static void eat_put_bExecute(const eat_ctx_type *ctx, int iValue)
+{
+  const char *myarg = ctx->myarg;
+  int motor_axis_no = ctx->motor_axis_no;
+  MOTOR_CMD_SET(motor_axis_no, bExecute, iValue);
+  if (!iValue) {
+    /* bExecute=0 is always allowed, regardless the command */
+    motorStop(motor_axis_no);
+    cmd_buf_printf("OK");
+    return;
+  } else if (iValue == 1) {
+    if (cmd_Motor_cmd[motor_axis_no].fVelocity >
+        cmd_Motor_cmd[motor_axis_no].maximumVelocity) {
+      fprintf(stdlog, "%s/%s:%d axis_no=%d velocity=%g maximumVelocity=%g\n",
+              __FILE__, __FUNCTION__, __LINE__,
+              motor_axis_no,
+              cmd_Motor_cmd[motor_axis_no].fVelocity,
+              cmd_Motor_cmd[motor_axis_no].maximumVelocity);
+      set_nErrorId(motor_axis_no, 0x4221);
+      cmd_buf_printf("OK");
+      return;
+    }
+    if (isMotorMoving(motor_axis_no)) {
+      int nErrorId = 0x1431C;
+      cmd_buf_printf("Error: %d", nErrorId);
+      set_nErrorId(motor_axis_no, nErrorId);
+      return;
+    }
+    switch (cmd_Motor_cmd[motor_axis_no].command_no) {
+      case 1:
+      {
+        int direction = 1;
+        if (cmd_Motor_cmd[motor_axis_no].fVelocity < 0) {
+          direction = 0;
+          cmd_Motor_cmd[motor_axis_no].fVelocity = -cmd_Motor_cmd[motor_axis_no].fVelocity;
+        }
+        (void)moveVelocity(motor_axis_no,
+                           direction,
+                           cmd_Motor_cmd[motor_axis_no].fVelocity,
+                           cmd_Motor_cmd[motor_axis_no].fAcceleration);
+        cmd_buf_printf("OK");
       }
+      break;
+      case 2:
+        (void)movePosition(motor_axis_no,
+                           cmd_Motor_cmd[motor_axis_no].fPosition,
+                           1, /* int relative, */
+                           cmd_Motor_cmd[motor_axis_no].fVelocity,
+                           cmd_Motor_cmd[motor_axis_no].fAcceleration);
+        cmd_buf_printf("OK");
         break;
-      case 2: {
-        int res;
-        int iValue = -1;
-        if (len_in_PLC != 2) return __LINE__;
-        res = motorHandleADS_ADR_getInt(adsport,
-                                        indexGroup,
-                                        indexOffset,
-                                        &iValue);
-        if (res) return res;
-        cmd_buf_printf("%d", iValue);
-        return -1;
-      }
+      case 3:
+        (void)movePosition(motor_axis_no,
+                           cmd_Motor_cmd[motor_axis_no].fPosition,
+                           0, /* int relative, */
+                           cmd_Motor_cmd[motor_axis_no].fVelocity,
+                           cmd_Motor_cmd[motor_axis_no].fAcceleration);
+        cmd_buf_printf("OK");
         break;
+      case 10:
+      {
+        if (cmd_Motor_cmd[motor_axis_no].homeVeloTowardsHomeSensor &&
+            cmd_Motor_cmd[motor_axis_no].homeVeloFromHomeSensor) {
+          (void)moveHomeProc(motor_axis_no,
+                             0, /* direction, */
+                             cmd_Motor_cmd[motor_axis_no].nCmdData,
+                             cmd_Motor_cmd[motor_axis_no].homeVeloTowardsHomeSensor,
+                             cmd_Motor_cmd[motor_axis_no].fAcceleration);
+          cmd_buf_printf("OK");
+        } else {
+          cmd_buf_printf("Error : %d %g %g",
+                         70000,
+                         cmd_Motor_cmd[motor_axis_no].homeVeloTowardsHomeSensor,
+                         cmd_Motor_cmd[motor_axis_no].homeVeloFromHomeSensor);
+        }
+      }
+      break;
       default:
-        return __LINE__;
+        RETURN_OR_DIE("%s/%s:%d line=%s command_no=%u",
+                      __FILE__, __FUNCTION__, __LINE__,
+                      myarg, cmd_Motor_cmd[motor_axis_no].command_no);
     }
+    return;
   }
-  return __LINE__;
+  RETURN_OR_DIE("%s/%s:%d line=%s invalid_iValue=%u '.'",
+                __FILE__, __FUNCTION__, __LINE__,
+                myarg,  iValue);
+}
+
+static void eat_put_bReset(const eat_ctx_type *ctx, int iValue)
+{
+  int motor_axis_no = ctx->motor_axis_no;
+  MOTOR_CMD_SET(motor_axis_no, bReset, iValue);
+  if (iValue) {
+    motorStop(motor_axis_no);
+    set_nErrorId(motor_axis_no, 0);
+  }
+  cmd_buf_printf("OK");
+}
+
+static const eat_field_type eat_fields[] = {
+  { "bBusy",          '?', eat_get_bBusy,         NULL, NULL },
+  { "bError",         '?', eat_get_bError,        NULL, NULL },
+  { "bEnable",        '?', eat_get_bEnabled,      NULL, NULL },
+  { "bEnabled",       '?', eat_get_bEnabled,      NULL, NULL },
+  { "bExecute",       '?', eat_get_bExecute,      NULL, NULL },
+  { "bHomeSensor",    '?', eat_get_bHomeSensor,   NULL, NULL },
+  { "bLimitBwd",      '?', eat_get_bLimitBwd,     NULL, NULL },
+  { "bLimitFwd",      '?', eat_get_bLimitFwd,     NULL, NULL },
+  { "bHomed",         '?', eat_get_bHomed,        NULL, NULL },
+  { "bReset",         '?', eat_get_bReset,        NULL, NULL },
+  { "fAcceleration",  '?', eat_get_fAcceleration, NULL, NULL },
+  { "fActPosition",   '?', eat_get_fActPosition,  NULL, NULL },
+  { "fActVelocity",   '?', eat_get_fActVelocity,  NULL, NULL },
+  { "fPosition",      '?', eat_get_fPosition,     NULL, NULL },
+  { "nCommand",       '?', eat_get_nCommand,      NULL, NULL },
+  { "nMotionAxisID",  '?', eat_get_nMotionAxisID, NULL, NULL },
+  { "stAxisStatus",   '?', eat_get_stAxisStatus,  NULL, NULL },
+  { "sErrorMessage",  '?', eat_get_sErrorMessage, NULL, NULL },
+  { "nCommand",       '=', NULL, eat_put_nCommand,  NULL },
+  { "nCmdData",       '=', NULL, eat_put_nCmdData,  NULL },
+  { "fPosition",      '=', NULL, NULL, eat_put_fPosition },
+  { "fHomePosition",  '=', NULL, NULL, eat_put_fHomePosition },
+  { "fVelocity",      '=', NULL, NULL, eat_put_fVelocity },
+  { "fAcceleration",  '=', NULL, NULL, eat_put_fAcceleration },
+  { "fDeceleration",  '=', NULL, NULL, eat_put_fDeceleration },
+  { "fJerk",          '=', NULL, NULL, eat_put_fJerk },
+  { "bEnable",        '=', NULL, eat_put_bEnable,   NULL },
+  { "bExecute",       '=', NULL, eat_put_bExecute,  NULL },
+  { "bReset",         '=', NULL, eat_put_bReset,    NULL },
+};
+
+#define NUM_EAT_FIELDS (sizeof(eat_fields) / sizeof(eat_fields[0]))
+/* Open addressing, a power of 2 and at least twice NUM_EAT_FIELDS */
+#define EAT_FIELD_HASH_LEN 128
+
+/* Index + 1 into eat_fields, 0 is an empty slot */
+static unsigned char eat_field_hash[EAT_FIELD_HASH_LEN];
+
+/* FNV-1a over the name and the suffix */
+static unsigned eat_field_hash_key(const char *name, size_t len, char suffix)
+{
+  unsigned h = 2166136261u;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  }
+  return (h ^ (unsigned char)suffix) * 16777619u;
+}
+
+static void eat_field_hash_init(void)
+{
+  unsigned i;
+  for (i = 0; i < NUM_EAT_FIELDS; i++) {
+    const eat_field_type *field = &eat_fields[i];
+    unsigned h = eat_field_hash_key(field->name, strlen(field->name),
+                                    field->suffix);
+    while (eat_field_hash[h & (EAT_FIELD_HASH_LEN - 1)]) {
+      h++;
+    }
+    eat_field_hash[h & (EAT_FIELD_HASH_LEN - 1)] = (unsigned char)(i + 1);
+  }
+}
+
+static const eat_field_type *eat_field_find(const char *name, size_t len,
+                                            char suffix)
+{
+  unsigned h;
+  unsigned idx;
+  h = eat_field_hash_key(name, len, suffix);
+  while ((idx = eat_field_hash[h & (EAT_FIELD_HASH_LEN - 1)])) {
+    const eat_field_type *field = &eat_fields[idx - 1];
+    if (field->suffix == suffix && !strncmp(field->name, name, len) &&
+        !field->name[len]) {
+      return field;
+    }
+    h++;
+  }
+  return NULL;
 }
 
+/*
+ * Once the tick runs, the gets read the snapshots of hw_motor and the
+ * fields written with MOTOR_CMD_SET(), without a lock.  Before that,
+ * they move the axis, which is locked.
+ * stAxisStatus locks only while it collects the values
+ */
+static void eat_field_get(const eat_ctx_type *ctx,
+                          const eat_field_type *field)
+{
+  int lock = !hw_motor_ticking() && field->get != eat_get_stAxisStatus;
+  if (lock) {
+    hw_motor_lock_axis(ctx->motor_axis_no);
+  }
+  field->get(ctx);
+  if (lock) {
+    hw_motor_unlock_axis(ctx->motor_axis_no);
+  }
+}
+
+/*
+ * Handle "bBusy?", "fPosition=100" and so on.
+ * Returns 0 if the command is not known, or the value can not be parsed
+ */
+static int eat_field_handle(const eat_ctx_type *ctx, const char *myarg_1)
+{
+  size_t len = strcspn(myarg_1, "?=");
+  char suffix = myarg_1[len];
+  const char *value = &myarg_1[len + 1];
+  const eat_field_type *field;
+
+  if (!suffix) return 0;
+  /* Nothing may follow the '?' */
+  if (suffix == '?' && *value) return 0;
+  field = eat_field_find(myarg_1, len, suffix);
+  if (!field) return 0;
+  if (field->get) {
+    eat_field_get(ctx, field);
+  } else if (field->put_int) {
+    int iValue;
+    if (sscanf(value, "%d", &iValue) != 1) return 0;
+    hw_motor_lock_axis(ctx->motor_axis_no);
+    field->put_int(ctx, iValue);
+    hw_motor_unlock_axis(ctx->motor_axis_no);
+  } else {
+    double fValue;
+    if (num_parse_double(value, &fValue) != 1) return 0;
+    hw_motor_lock_axis(ctx->motor_axis_no);
+    field->put_float(ctx, fValue);
+    hw_motor_unlock_axis(ctx->motor_axis_no);
+  }
+  return 1;
+}
+
+/*
+ * Subscriptions, instead of polling:
+ *   Main.M1.bBusy.notify=change,100         pushed when it has changed,
+ *                                           looked at every 100 ms
+ *   Main.M1.stAxisStatus.notify=cycle,1000  pushed every 1000 ms
+ *   Main.M1.bBusy.notify=off
+ * The pushed lines look like the answers: Main.M1.bBusy=0;
+ * Returns 0 if myarg_1 is not "<field>.notify=", 1 if done, -1 on error
+ */
+static int eat_notify_handle(const eat_ctx_type *ctx, const char *myarg_1)
+{
+  static const char notify_equals_str[] = ".notify=";
+  const char *policy = strstr(myarg_1, notify_equals_str);
+  size_t field_len;
+  char name[64];
+  unsigned cycle_ms = 0;
+  int on_change = 0;
+  char dummy;
+
+  if (!policy) return 0;
+  field_len = policy - myarg_1;
+  if (!eat_field_find(myarg_1, field_len, '?')) return -1;
+  policy += sizeof(notify_equals_str) - 1;
+  if (!strcmp(policy, "off")) {
+    cycle_ms = 0;
+  } else if (sscanf(policy, "change,%u%c", &cycle_ms, &dummy) == 1 &&
+             cycle_ms) {
+    on_change = 1;
+  } else if (sscanf(policy, "cycle,%u%c", &cycle_ms, &dummy) != 1 ||
+             !cycle_ms) {
+    return -1;
+  }
+  snprintf(name, sizeof(name), "Main.M%d.%.*s",
+           ctx->cmd_axis_no, (int)field_len, myarg_1);
+  if (socket_subscribe(cmd_socket_fd(), name, cycle_ms, on_change)) {
+    return -1;
+  }
+  cmd_buf_printf("OK");
+  return 1;
+}
+
+void cmd_EAT_notify(const char *name)
+{
+  const eat_field_type *field;
+  const char *field_name;
+  eat_ctx_type ctx;
+  int cmd_axis_no;
+
+  if (sscanf(name, "Main.M%d.", &cmd_axis_no) != 1) return;
+  field_name = strchr(name + strlen(Main_dot_str), '.');
+  if (!field_name) return;
+  field_name++;
+  field = eat_field_find(field_name, strlen(field_name), '?');
+  if (!field) return;
+  ctx.myarg = name;
+  ctx.cmd_axis_no = cmd_axis_no;
+  ctx.motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
+  AXIS_CHECK_RETURN(ctx.motor_axis_no);
+  /* stAxisStatus has the name in its answer already */
+  if (field->get != eat_get_stAxisStatus) {
+    cmd_buf_printf("%s=", name);
+  }
+  eat_field_get(&ctx, field);
+  cmd_buf_printf("%s\n", seperator_seperator);
+}
 
 static void motorHandleOneArg(const char *myarg_1)
 {
   static const char * const ADSPORT_sFeaturesQ_str = "ADSPORT=852/.THIS.sFeatures?";
   const char *myarg = myarg_1;
-  int iValue = 0;
-  double fValue = 0;
+  int cmd_axis_no = 0;
   int motor_axis_no = 0;
   int nvals = 0;
+  int res;
 
   /* ADSPORT=852/.THIS.sFeatures? */
   if (0 == strcmp(myarg_1, ADSPORT_sFeaturesQ_str)) {
@@ -512,10 +1272,14 @@ static void motorHandleOneArg(const char *myarg_1)
   /* getAxisDebugInfoData(1) */
   if (!strncmp(myarg_1, getAxisDebugInfoData_str, strlen(getAxisDebugInfoData_str))) {
     myarg_1 += strlen(getAxisDebugInfoData_str);
-    nvals = sscanf(myarg_1, "(%d)", &motor_axis_no);
+    nvals = sscanf(myarg_1, "(%d)", &cmd_axis_no);
     if (nvals == 1) {
       char buf[80];
+      motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
+      init_axis(motor_axis_no);
+      hw_motor_lock_axis(motor_axis_no);
       getAxisDebugInfoData(motor_axis_no, buf, sizeof(buf));
+      hw_motor_unlock_axis(motor_axis_no);
       cmd_buf_printf("%s", buf);
       return;
     } else {
@@ -530,14 +1294,24 @@ static void motorHandleOneArg(const char *myarg_1)
     myarg_1 += strlen(Main_dot_str);
   }
 
+  /* M*.stAxisStatus? */
+  res = motorHandleAxisList(myarg, myarg_1);
+  if (res > 0) {
+    return;
+  } else if (res < 0) {
+    RETURN_OR_DIE("%s/%s:%d line=%s",
+                  __FILE__, __FUNCTION__, __LINE__,
+                  myarg);
+  }
   /* From here on, only M1. commands */
   /* e.g. M1.nCommand=3 */
-  nvals = sscanf(myarg_1, "M%d.", &motor_axis_no);
+  nvals = sscanf(myarg_1, "M%d.", &cmd_axis_no);
   if (nvals != 1) {
     RETURN_OR_DIE("%s/%s:%d line=%s myarg_1=%s nvals=%d",
                   __FILE__, __FUNCTION__, __LINE__,
                   myarg, myarg_1, nvals);
   }
+  motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
   AXIS_CHECK_RETURN(motor_axis_no);
   myarg_1 = strchr(myarg_1, '.');
   if (!myarg_1) {
@@ -546,308 +1320,22 @@ static void motorHandleOneArg(const char *myarg_1)
                   myarg);
   }
   myarg_1++; /* Jump over '.' */
-  if (0 == strcmp(myarg_1, "bBusy?")) {
-    cmd_buf_printf("%d", isMotorMoving(motor_axis_no));
-    return;
-  }
-  /* bError?  */
-  if (!strcmp(myarg_1, "bError?")) {
-    cmd_buf_printf("%d", get_bError(motor_axis_no));
-    return;
-  }
-
-  /* bEnable? bEnabled? Both are the same in the simulator */
-  if (!strcmp(myarg_1, "bEnable?") || !strcmp(myarg_1, "bEnabled?")) {
-    cmd_buf_printf("%d",getAmplifierOn(motor_axis_no));
-    return;
-  }
-  /* bExecute? */
-  if (!strcmp(myarg_1, "bExecute?")) {
-    cmd_buf_printf("%d", cmd_Motor_cmd[motor_axis_no].bExecute);
-    return;
-  }
-  /* bHomeSensor? */
-  if (0 == strcmp(myarg_1, "bHomeSensor?")) {
-    cmd_buf_printf("%d", getAxisHome(motor_axis_no));
-    return;
-  }
-  /* bLimitBwd? */
-  if (0 == strcmp(myarg_1, "bLimitBwd?")) {
-    cmd_buf_printf("%d", getNegLimitSwitch(motor_axis_no) ? 0 : 1);
-    return;
-  }
-  /* bLimitFwd? */
-  if (0 == strcmp(myarg_1, "bLimitFwd?")) {
-    cmd_buf_printf("%d", getPosLimitSwitch(motor_axis_no) ? 0 : 1);
-    return;
-  }
-  /* bHomed? */
-  if (0 == strcmp(myarg_1, "bHomed?")) {
-    cmd_buf_printf("%d", getAxisHomed(motor_axis_no) ? 1 : 0);
-    return;
-  }
-  /* bReset? */
-  if (!strcmp(myarg_1, "bReset?")) {
-    cmd_buf_printf("%d",cmd_Motor_cmd[motor_axis_no].bReset);
-    return;
-  }
-  /* fAcceleration? */
-  if (0 == strcmp(myarg_1, "fAcceleration?")) {
-    cmd_buf_printf("%g", cmd_Motor_cmd[motor_axis_no].fAcceleration);
-    return;
-  }
-  /* fActPosition? */
-  if (0 == strcmp(myarg_1, "fActPosition?")) {
-    cmd_buf_printf("%g", getMotorPos(motor_axis_no));
-    return;
-  }
-  /* fActVelocity? */
-  if (0 == strcmp(myarg_1, "fActVelocity?")) {
-    cmd_buf_printf("%g", getMotorVelocity(motor_axis_no));
-    return;
-  }
-  /* fPosition? */
-  if (0 == strcmp(myarg_1, "fPosition?")) {
-    /* The "set" value */
-    cmd_buf_printf("%g", cmd_Motor_cmd[motor_axis_no].fPosition);
-    return;
-  }
-  /* nCommand? */
-  if (0 == strcmp(myarg_1, "nCommand?")) {
-    cmd_buf_printf("%d", cmd_Motor_cmd[motor_axis_no].command_no);
-    return;
-  }
-  /* nMotionAxisID? */
-  if (0 == strcmp(myarg_1, "nMotionAxisID?")) {
-    /* The NC axis id is the same as motion axis id */
-    printf("%s/%s:%d %s(%d)\n",  __FILE__, __FUNCTION__, __LINE__,
-           myarg_1, motor_axis_no);
-    cmd_buf_printf("%d", motor_axis_no);
-    return;
-  }
-  /* stAxisStatus? */
-  if (0 == strcmp(myarg_1, "stAxisStatus?")) {
-    int bJogFwd = 0;
-    int bJogBwd = 0;
-    double fOverride = 0;
-    /* getMotorPos must be first, it calls simulateMotion() */
-    cmd_Motor_status[motor_axis_no].fActPostion = getMotorPos(motor_axis_no);
-    cmd_Motor_status[motor_axis_no].bEnable = getAmplifierOn(motor_axis_no);
-    cmd_Motor_status[motor_axis_no].bEnabled = getAmplifierOn(motor_axis_no);
-    cmd_Motor_status[motor_axis_no].bLimitFwd = getPosLimitSwitch(motor_axis_no) ? 0 : 1;
-    cmd_Motor_status[motor_axis_no].bLimitBwd = getNegLimitSwitch(motor_axis_no) ? 0 : 1;
-    cmd_Motor_status[motor_axis_no].bHomeSensor = getAxisHome(motor_axis_no);
-    cmd_Motor_status[motor_axis_no].bError = get_bError(motor_axis_no);
-    cmd_Motor_status[motor_axis_no].nErrorId = get_nErrorId(motor_axis_no);
-    cmd_Motor_status[motor_axis_no].fActVelocity = getMotorVelocity(motor_axis_no);
-    cmd_Motor_status[motor_axis_no].bHomed = getAxisHomed(motor_axis_no);
-    cmd_Motor_status[motor_axis_no].bBusy = isMotorMoving(motor_axis_no);
-
-    cmd_buf_printf("Main.M%d.stAxisStatus="
-                   "%d,%d,%d,%u,%u,%g,%g,%g,%g,%d,"
-                   "%d,%d,%d,%g,%d,%d,%d,%u,%g,%g,%g,%d,%d",
-                   motor_axis_no,
-                   cmd_Motor_status[motor_axis_no].bEnable,        /*  1 */
-                   cmd_Motor_status[motor_axis_no].bReset,         /*  2 */
-                   cmd_Motor_cmd[motor_axis_no].bExecute,          /*  3 */
-                   cmd_Motor_status[motor_axis_no].nCommand,       /*  4 */
-                   cmd_Motor_cmd[motor_axis_no].nCmdData,          /*  5 */
-                   cmd_Motor_status[motor_axis_no].fVelocity,      /*  6 */
-                   cmd_Motor_status[motor_axis_no].fPosition,      /*  7 */
-                   cmd_Motor_cmd[motor_axis_no].fAcceleration,     /*  8 */
-                   cmd_Motor_cmd[motor_axis_no].fDeceleration,     /*  9 */
-                   bJogFwd,        /* 10 */
-                   bJogBwd,        /* 11 */
-                   cmd_Motor_status[motor_axis_no].bLimitFwd,      /* 12 */
-                   cmd_Motor_status[motor_axis_no].bLimitBwd,      /* 13 */
-                   fOverride,      /* 14 */
-                   cmd_Motor_status[motor_axis_no].bHomeSensor,    /* 15 */
-                   cmd_Motor_status[motor_axis_no].bEnabled,       /* 16 */
-                   cmd_Motor_status[motor_axis_no].bError,         /* 17 */
-                   cmd_Motor_status[motor_axis_no].nErrorId,       /* 18 */
-                   cmd_Motor_status[motor_axis_no].fActVelocity,   /* 19 */
-                   cmd_Motor_status[motor_axis_no].fActPostion,    /* 20 */
-                   cmd_Motor_status[motor_axis_no].fActDiff,       /* 21 */
-                   cmd_Motor_status[motor_axis_no].bHomed,         /* 22 */
-                   cmd_Motor_status[motor_axis_no].bBusy           /* 23 */
-                   );
-    return;
-  }
-  /* sErrorMessage?  */
-  if (!strcmp(myarg_1, "sErrorMessage?")) {
-    char buf[32]; /* 9 should be OK */
-    int nErrorId = get_nErrorId(motor_axis_no);
-    snprintf(buf, sizeof(buf), "%x", nErrorId);
-    cmd_buf_printf("%s", buf);
-    return;
-  }
-
-  /* End of "get" commands, from here, set commands */
-
-  /* nCommand=3 */
-  nvals = sscanf(myarg_1, "nCommand=%d", &iValue);
-  if (nvals == 1) {
-    cmd_Motor_cmd[motor_axis_no].command_no = iValue;
-    cmd_buf_printf("OK");
-    return;
-  }
-  /* nCmdData=1 */
-  nvals = sscanf(myarg_1, "nCmdData=%d", &iValue);
-  if (nvals == 1) {
-    cmd_Motor_cmd[motor_axis_no].nCmdData = iValue;
-    cmd_buf_printf("OK");
-    return;
-  }
-  /* fPosition=100 */
-  nvals = sscanf(myarg_1, "fPosition=%lf", &fValue);
-  if (nvals == 1) {
-    cmd_Motor_cmd[motor_axis_no].fPosition = fValue;
-    cmd_buf_printf("OK");
-    return;
-  }
-  /* fHomePosition */
-  nvals = sscanf(myarg_1, "fHomePosition=%lf", &fValue);
-  if (nvals == 1) {
-    /* Do noting */
-    cmd_buf_printf("OK");
-    return;
-  }
-
-
-  /* fVelocity=20 */
-  nvals = sscanf(myarg_1, "fVelocity=%lf", &fValue);
-  if (nvals == 1) {
-    cmd_Motor_cmd[motor_axis_no].fVelocity = fValue;
-    cmd_buf_printf("OK");
-    return;
-  }
-  /* fAcceleration=1000 */
-  nvals = sscanf(myarg_1, "fAcceleration=%lf", &fValue);
-  if (nvals == 1) {
-    cmd_Motor_cmd[motor_axis_no].fAcceleration = fValue;
-    cmd_buf_printf("OK");
-    return;
-  }
-  /* fDeceleration=1000 */
-  nvals = sscanf(myarg_1, "fDeceleration=%lf", &fValue);
-  if (nvals == 1) {
-    cmd_Motor_cmd[motor_axis_no].fDeceleration = fValue;
-    cmd_buf_printf("OK");
-    return;
-  }
-  /* bEnable= */
-  nvals = sscanf(myarg_1, "bEnable=%d", &iValue);
-  if (nvals == 1) {
-    int amplifierLockedToBeOff = getAmplifierLockedToBeOff(motor_axis_no);
-    if (amplifierLockedToBeOff) {
-      setAmplifierPercent(motor_axis_no, 0);
-      if (amplifierLockedToBeOff == AMPLIFIER_LOCKED_TO_BE_OFF_LOUD) {
-        cmd_buf_printf("Amplifier locked");
-        return;
-      }
-      iValue = 0;
-    }
-    setAmplifierPercent(motor_axis_no, iValue ? 100 : 0);
-    cmd_buf_printf("OK");
-    return;
-  }
-  /* bExecute= */
-  nvals = sscanf(myarg_1, "bExecute=%d", &iValue);
-  if (nvals == 1) {
-    cmd_Motor_cmd[motor_axis_no].bExecute = iValue;
-    if (!iValue) {
-      /* bExecute=0 is always allowed, regardless the command */
-      motorStop(motor_axis_no);
-      cmd_buf_printf("OK");
-      return;
-    } else if (iValue == 1) {
-      if (cmd_Motor_cmd[motor_axis_no].fVelocity >
-          cmd_Motor_cmd[motor_axis_no].maximumVelocity) {
-        fprintf(stdlog, "%s/%s:%d axis_no=%d velocity=%g maximumVelocity=%g\n",
-                __FILE__, __FUNCTION__, __LINE__,
-                motor_axis_no,
-                cmd_Motor_cmd[motor_axis_no].fVelocity,
-                cmd_Motor_cmd[motor_axis_no].maximumVelocity);
-        set_nErrorId(motor_axis_no, 0x4221);
-        cmd_buf_printf("OK");
-        return;
-      }
-      if (isMotorMoving(motor_axis_no)) {
-        int nErrorId = 0x1431C;
-        cmd_buf_printf("Error: %d", nErrorId);
-        set_nErrorId(motor_axis_no, nErrorId);
-        return;
-      }
-      switch (cmd_Motor_cmd[motor_axis_no].command_no) {
-        case 1:
-        {
-          int direction = 1;
-          if (cmd_Motor_cmd[motor_axis_no].fVelocity < 0) {
-            direction = 0;
-            cmd_Motor_cmd[motor_axis_no].fVelocity = -cmd_Motor_cmd[motor_axis_no].fVelocity;
-          }
-          (void)moveVelocity(motor_axis_no,
-                             direction,
-                             cmd_Motor_cmd[motor_axis_no].fVelocity,
-                             cmd_Motor_cmd[motor_axis_no].fAcceleration);
-          cmd_buf_printf("OK");
-        }
-        break;
-        case 2:
-          (void)movePosition(motor_axis_no,
-                             cmd_Motor_cmd[motor_axis_no].fPosition,
-                             1, /* int relative, */
-                             cmd_Motor_cmd[motor_axis_no].fVelocity,
-                             cmd_Motor_cmd[motor_axis_no].fAcceleration);
-          cmd_buf_printf("OK");
-          break;
-        case 3:
-          (void)movePosition(motor_axis_no,
-                             cmd_Motor_cmd[motor_axis_no].fPosition,
-                             0, /* int relative, */
-                             cmd_Motor_cmd[motor_axis_no].fVelocity,
-                             cmd_Motor_cmd[motor_axis_no].fAcceleration);
-          cmd_buf_printf("OK");
-          break;
-        case 10:
-        {
-          if (cmd_Motor_cmd[motor_axis_no].homeVeloTowardsHomeSensor &&
-              cmd_Motor_cmd[motor_axis_no].homeVeloFromHomeSensor) {
-            (void)moveHomeProc(motor_axis_no,
-                               0, /* direction, */
-                               cmd_Motor_cmd[motor_axis_no].nCmdData,
-                               cmd_Motor_cmd[motor_axis_no].homeVeloTowardsHomeSensor,
-                               cmd_Motor_cmd[motor_axis_no].fAcceleration);
-            cmd_buf_printf("OK");
-          } else {
-            cmd_buf_printf("Error : %d %g %g",
-                           70000,
-                           cmd_Motor_cmd[motor_axis_no].homeVeloTowardsHomeSensor,
-                           cmd_Motor_cmd[motor_axis_no].homeVeloFromHomeSensor);
-          }
-        }
-        break;
-        default:
-          RETURN_OR_DIE("%s/%s:%d line=%s command_no=%u",
-                        __FILE__, __FUNCTION__, __LINE__,
-                        myarg, cmd_Motor_cmd[motor_axis_no].command_no);
-      }
+  {
+    eat_ctx_type ctx;
+    ctx.myarg = myarg;
+    ctx.cmd_axis_no = cmd_axis_no;
+    ctx.motor_axis_no = motor_axis_no;
+    res = eat_notify_handle(&ctx, myarg_1);
+    if (res > 0) {
       return;
+    } else if (res < 0) {
+      RETURN_OR_DIE("%s/%s:%d line=%s",
+                    __FILE__, __FUNCTION__, __LINE__,
+                    myarg);
     }
-    RETURN_OR_DIE("%s/%s:%d line=%s invalid_iValue=%u '.'",
-                  __FILE__, __FUNCTION__, __LINE__,
-                  myarg,  iValue);
-  }
-  /* bReset= */
-  nvals = sscanf(myarg_1, "bReset=%d", &iValue);
-  if (nvals == 1) {
-    cmd_Motor_cmd[motor_axis_no].bReset = iValue;
-    if (iValue) {
-      motorStop(motor_axis_no);
-      set_nErrorId(motor_axis_no, 0);
+    if (eat_field_handle(&ctx, myarg_1)) {
+      return;
     }
-    cmd_buf_printf("OK");
-    return;
   }
   /* if we come here, we do not understand the command */
   RETURN_OR_DIE("%s/%s:%d line=%s",
@@ -855,27 +1343,22 @@ static void motorHandleOneArg(const char *myarg_1)
                 myarg);
 }
 
-void cmd_EAT(int argc, const char *argv[])
+void cmd_EAT(int argc, const cmd_span_type argv[])
 {
-  const char *myargline = (argc > 0) ? argv[0] : "";
   if (PRINT_STDOUT_BIT6())
   {
-    const char *myarg[5];
-    myarg[0] = myargline;
-    myarg[1] = (argc > 1) ? argv[1] : "";
-    myarg[2] = (argc > 2) ? argv[2] : "";
-    myarg[3] = (argc > 3) ? argv[3] : "";
-    myarg[4] = (argc > 4) ? argv[4] : "";
-    LOGINFO6("%s/%s:%d argc=%d "
-             "myargline=\"%s\" myarg[1]=\"%s\" myarg[2]=\"%s\" myarg[3]=\"%s\" myarg[4]=\"%s\"\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             argc,  myargline,
-             myarg[1], myarg[2],
-             myarg[3], myarg[4]);
+    /* The line, argument by argument: argv[0] is no C string */
+    int i;
+    LOGINFO6("%s/%s:%d argc=%d\n",
+             __FILE__, __FUNCTION__, __LINE__, argc);
+    for (i = 1; i < argc; i++) {
+      LOGINFO6("%s/%s:%d myarg[%d]=\"%s\"\n",
+               __FILE__, __FUNCTION__, __LINE__, i, argv[i].ptr);
+    }
   }
 
   while (argc > 1) {
-    motorHandleOneArg(argv[1]);
+    motorHandleOneArg(argv[1].ptr);
     cmd_buf_printf("%s", seperator_seperator);
     argc--;
     argv++;
@@ -1 +1,16 @@
-void cmd_EAT(int argc, const char *argv[]);
+#include "cmd.h"
+void cmd_EAT(int argc, const cmd_span_type argv[]);
+/* Allocate the state of the axes, once at startup.  -1 on error */
+int cmd_EAT_alloc_axes(void);
+/* The line pushed for a subscription like "Main.M1.fActPosition" */
+void cmd_EAT_notify(const char *name);
+
+/*
+ * The parameters of "ADSPORT=501/.ADR." as little endian PLC data,
+ * for binary ADS.  len must be the length in the PLC.
+ * Returns ADSERR_NOERR or an ADS error code
+ */
+unsigned cmd_EAT_ads_read(unsigned indexGroup, unsigned indexOffset,
+                          unsigned char *data, unsigned len);
+unsigned cmd_EAT_ads_write(unsigned indexGroup, unsigned indexOffset,
+                           const unsigned char *data, unsigned len);
@@ -9,6 +9,7 @@
 #include "hw_motor.h"
 #include "cmd_IcePAP.h"
 #include "cmd_IcePAP-internal.h"
+#include "cmd.h"
 
 #define ICEPAP_SEND_NEWLINE  1
 #define ICEPAP_SEND_OK 2
@@ -20,12 +21,22 @@ typedef struct
   int    velocity;
 } cmd_Motor_cmd_type;
 
-static cmd_Motor_cmd_type cmd_Motor_cmd[MAX_AXES];
+static cmd_Motor_cmd_type *cmd_Motor_cmd;
+static char *init_done;
+
+int cmd_IcePAP_alloc_axes(void)
+{
+  cmd_Motor_cmd = calloc(MAX_AXES, sizeof(*cmd_Motor_cmd));
+  init_done = calloc(MAX_AXES, sizeof(*init_done));
+  if (!cmd_Motor_cmd || !init_done) {
+    return -1;
+  }
+  return 0;
+}
 
 
 static void init_axis(int axis_no)
 {
-  static char init_done[MAX_AXES];
   const double MRES = 0.03;
   const double ERES = MRES;
   double ReverseMRES = (double)1.0/MRES;
@@ -33,6 +44,10 @@ static void init_axis(int axis_no)
   if (axis_no >= MAX_AXES || axis_no < 0) {
     return;
   }
+  if (__atomic_load_n(&init_done[axis_no], __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  hw_motor_lock_axis(axis_no);
   if (!init_done[axis_no]) {
     struct motor_init_values motor_init_values;
     double valueLow = -1.0;
@@ -50,13 +65,15 @@ static void init_axis(int axis_no)
                   &motor_init_values,
                   sizeof(motor_init_values));
     setAmplifierPercent(axis_no,100);
-    init_done[axis_no] = 1;
+    __atomic_store_n(&init_done[axis_no], 1, __ATOMIC_RELEASE);
   }
+  hw_motor_unlock_axis(axis_no);
 }
 
 
 static int handle_IcePAP_cmd(const char *myarg_1)
 {
+  int cmd_axis_no = 0;
   int motor_axis_no = 0;
   int nvals = 0;
   int ret = ICEPAP_SEND_NEWLINE;
@@ -64,10 +81,11 @@ static int handle_IcePAP_cmd(const char *myarg_1)
     ret = ICEPAP_SEND_OK; /* Jump over '#' */
     myarg_1++;
   }
-  nvals = sscanf(myarg_1, "%d:", &motor_axis_no);
+  nvals = sscanf(myarg_1, "%d:", &cmd_axis_no);
   if (nvals != 1) {
     return 0; /* Not IcePAP */
   }
+  motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
   AXIS_CHECK_RETURN_ZERO(motor_axis_no);
   myarg_1 = strchr(myarg_1, ':');
   if (!myarg_1) {
@@ -96,12 +114,12 @@ static int handle_IcePAP_cmd(const char *myarg_1)
     if (getNegLimitSwitch(motor_axis_no)) status |= STATUS_BIT_LIMIT_NEG;
     if (1)                                status |= STATUS_BIT_POWERON; /* Power always on for now */
     if (!(status & STATUS_BIT_MOVING))    status |= STATUS_BIT_READY;
-    cmd_buf_printf("%d:?STATUS %x", motor_axis_no, status);
+    cmd_buf_printf("%d:?STATUS %x", cmd_axis_no, status);
     return ICEPAP_SEND_NEWLINE;
   }
   if (0 == strcmp(myarg_1, "?POS")) {
     int value = (int)getMotorPos(motor_axis_no);
-    cmd_buf_printf("%d:%s %d", motor_axis_no, myarg_1, value);
+    cmd_buf_printf("%d:%s %d", cmd_axis_no, myarg_1, value);
     return ICEPAP_SEND_NEWLINE;
   }
   if (0 == strcmp(myarg_1, "?HOMESTAT")) {
@@ -111,32 +129,32 @@ static int handle_IcePAP_cmd(const char *myarg_1)
     } else {
       status_txt = "NOTFOUND";
     }
-    cmd_buf_printf("%d:%s %s", motor_axis_no, myarg_1, status_txt);
+    cmd_buf_printf("%d:%s %s", cmd_axis_no, myarg_1, status_txt);
     return ICEPAP_SEND_NEWLINE;
   }
   /* 1:?POWER */
   if (0 == strcmp(myarg_1, "?POWER")) {
     /* Power always on for now */
-    cmd_buf_printf("%d:%s %s", motor_axis_no, myarg_1 ,"ON");
+    cmd_buf_printf("%d:%s %s", cmd_axis_no, myarg_1 ,"ON");
     return ICEPAP_SEND_NEWLINE;
   }
   if (0 == strcmp(myarg_1, "?VELOCITY")) {
     int velocity = 333;
-    cmd_buf_printf("%d:%s %d", motor_axis_no, myarg_1, velocity);
+    cmd_buf_printf("%d:%s %d", cmd_axis_no, myarg_1, velocity);
     return ICEPAP_SEND_NEWLINE;
   }
   if (0 == strcmp(myarg_1, "?JOG")) {
     int jog = 0;
-    cmd_buf_printf("%d:%s %d", motor_axis_no, myarg_1, jog);
+    cmd_buf_printf("%d:%s %d", cmd_axis_no, myarg_1, jog);
     return ICEPAP_SEND_NEWLINE;
   }
   if (0 == strcmp(myarg_1, "?ACCTIME")) {
     int acctime = 0;
-    cmd_buf_printf("%d:%s %d", motor_axis_no, myarg_1, acctime);
+    cmd_buf_printf("%d:%s %d", cmd_axis_no, myarg_1, acctime);
     return ICEPAP_SEND_NEWLINE;
   }
   if (0 == strcmp(myarg_1, "?CFG")) {
-    cmd_buf_printf("%d:%s %s", motor_axis_no, myarg_1, cfg_Axis_str);
+    cmd_buf_printf("%d:%s %s", cmd_axis_no, myarg_1, cfg_Axis_str);
     return ICEPAP_SEND_NEWLINE;
   }
   return 0;
@@ -145,6 +163,7 @@ static int handle_IcePAP_cmd(const char *myarg_1)
 
 static int handle_IcePAP_cmd3(const char *myarg_1, const char *myarg_2)
 {
+  int cmd_axis_no = 0;
   int motor_axis_no = 0;
   int value = 0;
   int nvals = 0;
@@ -156,7 +175,8 @@ static int handle_IcePAP_cmd3(const char *myarg_1, const char *myarg_2)
   (void)ret;
   /* ?FPOS 1 */
   if (0 == strcmp(myarg_1, "?FPOS")) {
-    nvals = sscanf(myarg_2, "%d", &motor_axis_no);
+    nvals = sscanf(myarg_2, "%d", &cmd_axis_no);
+    motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
     LOGINFO4("%s/%s:%d nvals=%d motor_axis_no=%d\n",
              __FILE__, __FUNCTION__, __LINE__,
              nvals, motor_axis_no);
@@ -166,10 +186,11 @@ static int handle_IcePAP_cmd3(const char *myarg_1, const char *myarg_2)
     }
   }
 
-  nvals = sscanf(myarg_1, "%d:", &motor_axis_no);
+  nvals = sscanf(myarg_1, "%d:", &cmd_axis_no);
   if (nvals != 1) {
     return 0; /* Not IcePAP */
   }
+  motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
   AXIS_CHECK_RETURN_ZERO(motor_axis_no);
   myarg_1 = strchr(myarg_1, ':');
   if (!myarg_1) {
@@ -189,7 +210,7 @@ static int handle_IcePAP_cmd3(const char *myarg_1, const char *myarg_2)
       moveVelocity(motor_axis_no,
                    value > 0, /* int direction */
                    velocity, /* double max_velocity, */
-                   1.0 /*double acceleration */ );
+                   0.0 /* double acceleration: at once */ );
       return ret;
     }
   }
@@ -202,7 +223,7 @@ static int handle_IcePAP_cmd3(const char *myarg_1, const char *myarg_2)
       moveHome(motor_axis_no,
                value, /* int direction */
                cmd_Motor_cmd[motor_axis_no].homevel,
-               1.0 /*double acceleration */ );
+               0.0 /* double acceleration: at once */ );
       return ret;
     }
   }
@@ -216,7 +237,7 @@ static int handle_IcePAP_cmd3(const char *myarg_1, const char *myarg_2)
                    (double)value,
                    0, /* int relative, */
                    cmd_Motor_cmd[motor_axis_no].velocity,
-                   1.0 /*double acceleration */ );
+                   0.0 /* double acceleration: at once */ );
       return ret; /* MOVE does respond */
     }
   }
@@ -248,18 +269,18 @@ static int handle_IcePAP_cmd3(const char *myarg_1, const char *myarg_2)
     if (0 == strcmp(myarg_2, "MAXPOS")) {
       int maxPos = 3500; /* (int)(getHighSoftLimitPos(motor_axis_no) /
                             getMotorReverseERES(motor_axis_no)); */
-      cmd_buf_printf("%d:%s %d", motor_axis_no, myarg_1, maxPos);
+      cmd_buf_printf("%d:%s %d", cmd_axis_no, myarg_1, maxPos);
       return ICEPAP_SEND_NEWLINE;
     }
     if (0 == strcmp(myarg_2, "MINPOS")) {
       int maxPos = 100; /* (int)(getLowSoftLimitPos(motor_axis_no) /
                            getMotorReverseERES(motor_axis_no)); */
-      cmd_buf_printf("%d:%s %d", motor_axis_no, myarg_1, maxPos);
+      cmd_buf_printf("%d:%s %d", cmd_axis_no, myarg_1, maxPos);
       return ICEPAP_SEND_NEWLINE;
     }
     if (0 == strcmp(myarg_2, "DEADBAND")) {
       int deadband = 10;
-      cmd_buf_printf("%d:%s %d", motor_axis_no, myarg_1, deadband);
+      cmd_buf_printf("%d:%s %d", cmd_axis_no, myarg_1, deadband);
       return ICEPAP_SEND_NEWLINE;
     }
     return 0;
@@ -276,7 +297,7 @@ static int handle_IcePAP_cmd3(const char *myarg_1, const char *myarg_2)
                    (double)value,
                    1, /* int relative, */
                    1000.0, /* double max_velocity, */
-                   1.0 /*double acceleration */ );
+                   0.0 /* double acceleration: at once */ );
       return ICEPAP_SEND_NEWLINE; /* MOVE doesn't respond */
     }
   }
@@ -288,6 +309,7 @@ static int handle_IcePAP_cmd4(const char *myarg_1,
                               const char *myarg_2,
                               const char *myarg_3)
 {
+  int cmd_axis_no = 0;
   int motor_axis_no = 0;
   int value = 0;
   int nvals = 0;
@@ -302,7 +324,8 @@ static int handle_IcePAP_cmd4(const char *myarg_1,
      (or axis number) and don't have a ':' */
   if (0 == strcmp(myarg_1, "?FPOS")) {
     if (0 == strcmp(myarg_2, "MEASURE")) {
-      nvals = sscanf(myarg_3, "%d", &motor_axis_no);
+      nvals = sscanf(myarg_3, "%d", &cmd_axis_no);
+      motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
       LOGINFO4("%s/%s:%d nvals=%d motor_axis_no=%d\n",
                __FILE__, __FUNCTION__, __LINE__,
                nvals, motor_axis_no);
@@ -315,10 +338,11 @@ static int handle_IcePAP_cmd4(const char *myarg_1,
       }
     }
   }
-  nvals = sscanf(myarg_1, "%d:", &motor_axis_no);
+  nvals = sscanf(myarg_1, "%d:", &cmd_axis_no);
   if (nvals != 1) {
     return 0; /* Not IcePAP */
   }
+  motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
   AXIS_CHECK_RETURN_ZERO(motor_axis_no);
   myarg_1 = strchr(myarg_1, ':');
   if (!myarg_1) {
@@ -363,51 +387,81 @@ static int handle_IcePAP_cmd4(const char *myarg_1,
   return 0;
 }
 
-int cmd_IcePAP(int argc, const char *argv[])
+/*
+ * The axis of the line, to be locked: "1:MOVE 2011", "#1:STOP",
+ * "?FPOS 1" or "?FPOS MEASURE 1".  0 if there is none
+ */
+static int icepap_axis_no(int argc, const cmd_span_type argv[])
+{
+  const char *myarg_1 = argv[1].ptr;
+  int cmd_axis_no = 0;
+  if (*myarg_1 == '#') {
+    myarg_1++;
+  }
+  if (!strcmp(myarg_1, "?FPOS")) {
+    if (sscanf(argv[argc - 1].ptr, "%d", &cmd_axis_no) != 1) {
+      return 0;
+    }
+  } else if (sscanf(myarg_1, "%d:", &cmd_axis_no) != 1) {
+    return 0;
+  }
+  return cmd_axis_no_to_hw(cmd_axis_no);
+}
+
+int cmd_IcePAP(int argc, const cmd_span_type argv[])
 {
   int ret = 0;
-  LOGINFO5("%s/%s:%d argc=%d argv[0]=%s\n",
+  int motor_axis_no = 0;
+  const char *argv1 = (argc > 1) ? argv[1].ptr : "";
+  LOGINFO5("%s/%s:%d argc=%d argv[1]=%s\n",
            __FILE__, __FUNCTION__, __LINE__,
-           argc, argv[0]);
+           argc, argv1);
   /* We use a UNIX like counting:
      argc == 3
-     argv[0]  "1:MOVE 2011" (non-UNIX: the whole command line)
+     argv[0]  span of "1:MOVE 2011" (non-UNIX: the whole command line,
+              no C string)
      argv[1]  "1:MOVE"
      argv[2]  "2011"
   */
+  if (argc >= 2) {
+    motor_axis_no = icepap_axis_no(argc, argv);
+    init_axis(motor_axis_no);
+  }
+  hw_motor_lock_axis(motor_axis_no);
   if (argc == 4) {
     LOGINFO5("%s/%s:%d argv[1]=%s argv[2]=%s\n",
              __FILE__, __FUNCTION__, __LINE__,
-             argv[1], argv[2]);
-    ret = handle_IcePAP_cmd4(argv[1], argv[2], argv[3]);
+             argv[1].ptr, argv[2].ptr);
+    ret = handle_IcePAP_cmd4(argv[1].ptr, argv[2].ptr, argv[3].ptr);
   } else if (argc == 3) {
     LOGINFO5("%s/%s:%d argv[1]=%s argv[2]=%s\n",
              __FILE__, __FUNCTION__, __LINE__,
-             argv[1], argv[2]);
-    ret = handle_IcePAP_cmd3(argv[1], argv[2]);
+             argv[1].ptr, argv[2].ptr);
+    ret = handle_IcePAP_cmd3(argv[1].ptr, argv[2].ptr);
   } else if  (argc == 2) {
     LOGINFO5("%s/%s:%d argv[1]=%s\n",
              __FILE__, __FUNCTION__, __LINE__,
-             argv[1]);
-    ret = handle_IcePAP_cmd(argv[1]);
+             argv[1].ptr);
+    ret = handle_IcePAP_cmd(argv[1].ptr);
   }
+  hw_motor_unlock_axis(motor_axis_no);
   switch (ret) {
     case ICEPAP_SEND_OK:
-      cmd_buf_printf("%s OK\n", &argv[1][1]); /* Don't echo '#' */
+      cmd_buf_printf("%s OK\n", &argv1[1]); /* Don't echo '#' */
       break;
     case ICEPAP_SEND_NEWLINE:
       cmd_buf_printf("\n");
       break;
     case ICEPAP_CMD_NOT_IMPLEMENTED:
-      LOGERR("%s/%s:%d argv[0]=%s\n",
+      LOGERR("%s/%s:%d argc=%d argv[1]=%s\n",
              __FILE__, __FUNCTION__, __LINE__,
-             argv[0]);
+             argc, argv1);
       /* We should have handled */
       break;
     default:
-      LOGERR("%s/%s:%d argv[0]=%s\n",
+      LOGERR("%s/%s:%d argc=%d argv[1]=%s\n",
              __FILE__, __FUNCTION__, __LINE__,
-             argv[0]);
+             argc, argv1);
       ;
   }
   return ret;
@@ -1 +1,4 @@
-int cmd_IcePAP(int argc, const char *argv[]);
+#include "cmd.h"
+int cmd_IcePAP(int argc, const cmd_span_type argv[]);
+/* Allocate the state of the axes, once at startup.  -1 on error */
+int cmd_IcePAP_alloc_axes(void);
@@ -8,10 +8,12 @@
 #include "cmd_buf.h"
 #include "hw_motor.h"
 #include "cmd_Sim.h"
+#include "cmd.h"
 
 static const char * const Sim_dot_str = "Sim.";
 static const char * const log_equals_str = "log=";
 static const char * const dbgCloseLogFile_str = "dbgCloseLogFile";
+static const char * const clock_equals_str = "clock=";
 
 static const char *seperator_seperator = ";";
 
@@ -19,11 +21,15 @@ static void init_axis(int axis_no)
 {
   (void)axis_no;
 }
+static void motorHandleAxisArg(int motor_axis_no, const char *myarg,
+                               const char *myarg_1);
+
 static void motorHandleOneArg(const char *myarg_1)
 {
   const char *myarg = myarg_1;
   int iValue = 0;
   double fValue = 0;
+  int cmd_axis_no = 0;
   int motor_axis_no = 0;
   int nvals = 0;
   (void)iValue;
@@ -36,13 +42,48 @@ static void motorHandleOneArg(const char *myarg_1)
     myarg_1 += strlen(Sim_dot_str);
   }
 
+  /* clock=real, clock=20 (times faster), clock=step */
+  if (!strncmp(myarg_1, clock_equals_str, strlen(clock_equals_str))) {
+    if (cmd_Sim_set_clock(myarg_1 + strlen(clock_equals_str))) {
+      RETURN_OR_DIE("%s/%s:%d line=%s invalid clock",
+                    __FILE__, __FUNCTION__, __LINE__,
+                    myarg);
+    }
+    cmd_buf_printf("OK");
+    return;
+  }
+  /* clock? */
+  if (!strcmp(myarg_1, "clock?")) {
+    double scale = hw_motor_get_clock_scale();
+    if (!scale) {
+      cmd_buf_printf("step");
+    } else if (scale == 1.0) {
+      cmd_buf_printf("real");
+    } else {
+      cmd_buf_printf("%g", scale);
+    }
+    return;
+  }
+  /* advance=100 (ms), with clock=step */
+  nvals = sscanf(myarg_1, "advance=%lf", &fValue);
+  if (nvals == 1) {
+    if (hw_motor_clock_advance(fValue)) {
+      RETURN_OR_DIE("%s/%s:%d line=%s the clock runs, or ms < 0",
+                    __FILE__, __FUNCTION__, __LINE__,
+                    myarg);
+    }
+    cmd_buf_printf("OK");
+    return;
+  }
+
   /* From here on, only M1. commands */
-  nvals = sscanf(myarg_1, "M%d.", &motor_axis_no);
+  nvals = sscanf(myarg_1, "M%d.", &cmd_axis_no);
   if (nvals != 1) {
     RETURN_OR_DIE("%s/%s:%d line=%s nvals=%d",
                   __FILE__, __FUNCTION__, __LINE__,
                   myarg, nvals);
   }
+  motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
   AXIS_CHECK_RETURN(motor_axis_no);
   myarg_1 = strchr(myarg_1, '.');
   if (!myarg_1) {
@@ -52,6 +93,19 @@ static void motorHandleOneArg(const char *myarg_1)
   }
   myarg_1++; /* Jump over '.' */
 
+  hw_motor_lock_axis(motor_axis_no);
+  motorHandleAxisArg(motor_axis_no, myarg, myarg_1);
+  hw_motor_unlock_axis(motor_axis_no);
+}
+
+/* The commands for one axis, with the axis locked */
+static void motorHandleAxisArg(int motor_axis_no, const char *myarg,
+                               const char *myarg_1)
+{
+  int iValue = 0;
+  double fValue = 0;
+  int nvals = 0;
+
   /* log= */
   if (!strncmp(myarg_1, log_equals_str, strlen(log_equals_str))) {
     int ret;
@@ -195,31 +249,54 @@ static void motorHandleOneArg(const char *myarg_1)
                 myarg, myarg_1);
 }
 
-void cmd_Sim(int argc, const char *argv[])
+void cmd_Sim(int argc, const cmd_span_type argv[])
 {
-  const char *myargline = (argc > 0) ? argv[0] : "";
   if (PRINT_STDOUT_BIT6())
   {
-    const char *myarg[5];
-    myarg[0] = myargline;
-    myarg[1] = (argc > 1) ? argv[1] : "";
-    myarg[2] = (argc > 2) ? argv[2] : "";
-    myarg[3] = (argc > 3) ? argv[3] : "";
-    myarg[4] = (argc > 4) ? argv[4] : "";
-    LOGINFO6("%s/%s:%d argc=%d "
-             "myargline=\"%s\" myarg[1]=\"%s\" myarg[2]=\"%s\" myarg[3]=\"%s\" myarg[4]=\"%s\"\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             argc,  myargline,
-             myarg[1], myarg[2],
-             myarg[3], myarg[4]);
+    /* The line, argument by argument: argv[0] is no C string */
+    int i;
+    LOGINFO6("%s/%s:%d argc=%d\n",
+             __FILE__, __FUNCTION__, __LINE__, argc);
+    for (i = 1; i < argc; i++) {
+      LOGINFO6("%s/%s:%d myarg[%d]=\"%s\"\n",
+               __FILE__, __FUNCTION__, __LINE__, i, argv[i].ptr);
+    }
   }
 
   while (argc > 1) {
-    motorHandleOneArg(argv[1]);
+    motorHandleOneArg(argv[1].ptr);
     cmd_buf_printf("%s", seperator_seperator);
     argc--;
     argv++;
   } /* while argc > 0 */
   cmd_buf_printf("%s", "\n");
 }
+
+int cmd_Sim_set_clock(const char *value)
+{
+  double scale;
+  char *end;
+  if (!strcmp(value, "real")) {
+    scale = 1.0;
+  } else if (!strcmp(value, "step")) {
+    scale = 0;
+  } else {
+    scale = strtod(value, &end);
+    if (end == value || *end || !(scale > 0)) {
+      return -1;
+    }
+  }
+  hw_motor_set_clock_scale(scale);
+  return 0;
+}
+
+int cmd_Sim_set_num_axes(int num_axes)
+{
+  return hw_motor_set_num_axes(num_axes);
+}
+
+void cmd_Sim_tick(void)
+{
+  hw_motor_tick();
+}
 /******************************************************************************/
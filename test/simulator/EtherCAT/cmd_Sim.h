@@ -1 +1,11 @@
-void cmd_Sim(int argc, const char *argv[]);
+#include "cmd.h"
+void cmd_Sim(int argc, const cmd_span_type argv[]);
+/*
+ * The clock of the simulation: "real", "step" (moves with Sim.advance=<ms>)
+ * or how many times faster than the real time it runs.  -1 if invalid
+ */
+int cmd_Sim_set_clock(const char *value);
+/* The number of axes of the simulator, once at startup.  -1 on error */
+int cmd_Sim_set_num_axes(int num_axes);
+/* Move all axes to the current time */
+void cmd_Sim_tick(void);
@@ -8,6 +8,7 @@
 #include "cmd_buf.h"
 #include "hw_motor.h"
 #include "cmd_TCPsim.h"
+#include "cmd.h"
 
 #define TCPSIM_SEND_NEWLINE  1
 #define TCPSIM_SEND_OK       2
@@ -18,11 +19,21 @@ typedef struct
   int    velocity;
 } cmd_Motor_cmd_type;
 
-static cmd_Motor_cmd_type cmd_Motor_cmd[MAX_AXES];
+static cmd_Motor_cmd_type *cmd_Motor_cmd;
+static char *init_done;
+
+int cmd_TCPsim_alloc_axes(void)
+{
+  cmd_Motor_cmd = calloc(MAX_AXES, sizeof(*cmd_Motor_cmd));
+  init_done = calloc(MAX_AXES, sizeof(*init_done));
+  if (!cmd_Motor_cmd || !init_done) {
+    return -1;
+  }
+  return 0;
+}
 
 static void init_axis(int axis_no)
 {
-  static char init_done[MAX_AXES];
   const static double MRES = 0.001;
   const double ERES = 1.0;
   double ReverseMRES = (double)1.0/MRES;
@@ -30,6 +41,10 @@ static void init_axis(int axis_no)
   if (axis_no >= MAX_AXES || axis_no < 0) {
     return;
   }
+  if (__atomic_load_n(&init_done[axis_no], __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  hw_motor_lock_axis(axis_no);
   if (!init_done[axis_no]) {
     struct motor_init_values motor_init_values;
     double valueLow = -1.0;
@@ -47,167 +62,220 @@ static void init_axis(int axis_no)
                   &motor_init_values,
                   sizeof(motor_init_values));
 
-    init_done[axis_no] = 1;
+    __atomic_store_n(&init_done[axis_no], 1, __ATOMIC_RELEASE);
   }
+  hw_motor_unlock_axis(axis_no);
 }
 
 
-static int handle_TCPSIM_cmd3(int motor_axis_no, const char *myarg_2)
+/* Status bits of ST? */
+#define STATUS_BIT_DIRECTION       0x1
+#define STATUS_BIT_DONE            0x2
+#define STATUS_BIT_MOVING          0x4
+#define STATUS_BIT_LIMIT_POS       0x8
+#define STATUS_BIT_LIMIT_NEG      0x10
+//#define STATUS_BIT_HOMING       0x20
+#define STATUS_BIT_HSIGNAL        0x40
+#define STATUS_BIT_HOMED          0x80
+#define STATUS_BIT_ERROR         0x100
+
+/*
+ * The handlers of the commands.  value is the argument of
+ * "1 MA 100", and 0 for commands without one like "1 POS?".
+ * They return TCPSIM_SEND_OK, TCPSIM_SEND_NEWLINE or 0 on error
+ */
+static int tcpsim_AB(int motor_axis_no, int value)
 {
-  AXIS_CHECK_RETURN_ZERO(motor_axis_no);
+  (void)value;
+  motorStop(motor_axis_no);
+  return TCPSIM_SEND_OK;
+}
 
-  /* AB (stop) */
-  if (0 == strcmp(myarg_2, "AB")) {
-    motorStop(motor_axis_no);
-    return TCPSIM_SEND_OK;
-  }
+static int tcpsim_POS(int motor_axis_no, int value)
+{
+  (void)value;
+  cmd_buf_printf("%ld", NINT(getMotorPos(motor_axis_no)));
+  return TCPSIM_SEND_NEWLINE;
+}
 
-  /* POS? */
-  if (0 == strcmp(myarg_2, "POS?")) {
-    cmd_buf_printf("%ld", NINT(getMotorPos(motor_axis_no)));
-    return TCPSIM_SEND_NEWLINE;
+static int tcpsim_ST(int motor_axis_no, int value)
+{
+  int axis_status = 0;
+  (void)value;
+  if (getAxisDone(motor_axis_no)) axis_status       |= STATUS_BIT_DONE;
+  if (isMotorMoving(motor_axis_no)) axis_status     |= STATUS_BIT_MOVING;
+  if (getNegLimitSwitch(motor_axis_no)) axis_status |= STATUS_BIT_LIMIT_NEG;
+  if (getPosLimitSwitch(motor_axis_no)) axis_status |= STATUS_BIT_LIMIT_POS;
+  if (getAxisHome(motor_axis_no)) axis_status       |= STATUS_BIT_HSIGNAL;
+  if (getAxisHomed(motor_axis_no)) axis_status      |= STATUS_BIT_HOMED;
+  if (get_bError(motor_axis_no)) axis_status        |= STATUS_BIT_ERROR;
+
+  cmd_buf_printf("%d", axis_status);
+  return TCPSIM_SEND_NEWLINE;
+}
+
+static int tcpsim_MA(int motor_axis_no, int value)
+{
+  movePosition(motor_axis_no,
+               (double)value,
+               0, /* int relative, */
+               cmd_Motor_cmd[motor_axis_no].velocity,
+               0.0 /* double acceleration: at once */ );
+  return TCPSIM_SEND_OK;
+}
+
+static int tcpsim_VEL(int motor_axis_no, int value)
+{
+  cmd_Motor_cmd[motor_axis_no].velocity = value;
+  return TCPSIM_SEND_OK;
+}
+
+static int tcpsim_HOM(int motor_axis_no, int value)
+{
+  moveHome(motor_axis_no,
+           value,
+           cmd_Motor_cmd[motor_axis_no].velocity,
+           0.0 /* double acceleration: at once */);
+  return TCPSIM_SEND_OK;
+}
+
+static int tcpsim_JOG(int motor_axis_no, int value)
+{
+  int direction = 1;
+  if (value < 0) {
+    direction = 0;
+    value = 0 - value;
   }
-  /* ST? */
-  if (0 == strcmp(myarg_2, "ST?")) {
-    /* Status bits */
-    #define STATUS_BIT_DIRECTION       0x1
-    #define STATUS_BIT_DONE            0x2
-    #define STATUS_BIT_MOVING          0x4
-    #define STATUS_BIT_LIMIT_POS       0x8
-    #define STATUS_BIT_LIMIT_NEG      0x10
-  //#define STATUS_BIT_HOMING         0x20
-    #define STATUS_BIT_HSIGNAL        0x40
-    #define STATUS_BIT_HOMED          0x80
-    #define STATUS_BIT_ERROR         0x100
-
-    int axis_status = 0;
-    if (getAxisDone(motor_axis_no)) axis_status       |= STATUS_BIT_DONE;
-    if (isMotorMoving(motor_axis_no)) axis_status     |= STATUS_BIT_MOVING;
-    if (getNegLimitSwitch(motor_axis_no)) axis_status |= STATUS_BIT_LIMIT_NEG;
-    if (getPosLimitSwitch(motor_axis_no)) axis_status |= STATUS_BIT_LIMIT_POS;
-    if (getAxisHome(motor_axis_no)) axis_status       |= STATUS_BIT_HSIGNAL;
-    if (getAxisHomed(motor_axis_no)) axis_status      |= STATUS_BIT_HOMED;
-    if (get_bError(motor_axis_no)) axis_status        |= STATUS_BIT_ERROR;
-
-    cmd_buf_printf("%d", axis_status);
-    return TCPSIM_SEND_NEWLINE;
+  moveVelocity(motor_axis_no,
+               direction,
+               (double)value,
+               0.0 /* double acceleration: at once */);
+  return TCPSIM_SEND_OK;
+}
+
+static int tcpsim_POW(int motor_axis_no, int value)
+{
+  if (setAmplifierPercent(motor_axis_no, value)) {
+    return 0;
   }
+  return TCPSIM_SEND_OK;
+}
 
-  return 0;
+typedef struct tcpsim_cmd_type {
+  const char *name;
+  int        has_value; /* "1 MA 100" has one, "1 POS?" has none */
+  int        (*handle)(int motor_axis_no, int value);
+} tcpsim_cmd_type;
+
+static const tcpsim_cmd_type tcpsim_cmds[] = {
+  { "AB",   0, tcpsim_AB  },
+  { "POS?", 0, tcpsim_POS },
+  { "ST?",  0, tcpsim_ST  },
+  { "MA",   1, tcpsim_MA  },
+  { "VEL",  1, tcpsim_VEL },
+  { "HOM",  1, tcpsim_HOM },
+  { "JOG",  1, tcpsim_JOG },
+  { "POW",  1, tcpsim_POW },
+};
+
+static const tcpsim_cmd_type *tcpsim_cmd_find(const char *name, int has_value)
+{
+  size_t i;
+  for (i = 0; i < sizeof(tcpsim_cmds) / sizeof(tcpsim_cmds[0]); i++) {
+    if (tcpsim_cmds[i].has_value == has_value &&
+        !strcmp(tcpsim_cmds[i].name, name)) {
+      return &tcpsim_cmds[i];
+    }
+  }
+  return NULL;
 }
 
-static int handle_TCPSIM_cmd4(int motor_axis_no,
-                              const char *myarg_2,
-                              const char *myarg_3)
+/*
+ * "* POS?" or "1-4 ST?": a query of many axes in one round trip.
+ * The values are separated by ' ', in the order of the axes.
+ * Returns 0 if argv1 is not "*" or "<n>-<m>", or the range is not valid
+ */
+static int handle_TCPSIM_axis_list(const char *argv1,
+                                   const tcpsim_cmd_type *tcpsim_cmd)
 {
-  int value = 0;
-  int nvals = -1;
-  AXIS_CHECK_RETURN_ZERO(motor_axis_no);
+  int num_axes = cmd_port_num_axes();
+  int first_axis = 1;
+  int last_axis;
+  int cmd_axis_no;
 
-  if (0 == strcmp(myarg_2, "MA")) {
-    nvals = sscanf(myarg_3, "%d", &value);
-    LOGINFO5("%s/%s:%d res=%d\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             nvals);
-    if (nvals == 1) {
-      movePosition(motor_axis_no,
-                   (double)value,
-                   0, /* int relative, */
-                   cmd_Motor_cmd[motor_axis_no].velocity,
-                   1.0 /*double acceleration */ );
-      return TCPSIM_SEND_OK;
-    }
+  if (!num_axes) {
+    num_axes = MAX_AXES - 1;
   }
-  if (0 == strcmp(myarg_2, "VEL")) {
-    nvals = sscanf(myarg_3, "%d", &value);
-    LOGINFO5("%s/%s:%d res=%d\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             nvals);
-    if (nvals == 1) {
-      cmd_Motor_cmd[motor_axis_no].velocity = value;
-      return TCPSIM_SEND_OK;
+  last_axis = num_axes;
+  if (strcmp(argv1, "*")) {
+    char dummy;
+    if (sscanf(argv1, "%d-%d%c", &first_axis, &last_axis, &dummy) != 2) {
+      return 0;
     }
   }
-  if (0 == strcmp(myarg_2, "HOM")) {
-    nvals = sscanf(myarg_3, "%d", &value);
-    LOGINFO5("%s/%s:%d res=%d\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             nvals);
-    if (nvals == 1) {
-      moveHome(motor_axis_no,
-               value,
-               cmd_Motor_cmd[motor_axis_no].velocity,
-               1 /* double acceleration */);
-      return TCPSIM_SEND_OK;
-    }
+  if (!strchr(tcpsim_cmd->name, '?') ||
+      first_axis < 1 || last_axis > num_axes || first_axis > last_axis) {
+    return 0;
   }
-  if (0 == strcmp(myarg_2, "JOG")) {
-    nvals = sscanf(myarg_3, "%d", &value);
-    LOGINFO5("%s/%s:%d res=%d\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             nvals);
-    if (nvals == 1) {
-      int direction = 1;
-      if (value < 0) {
-        direction = 0;
-        value = 0 - value;
-      }
-      moveVelocity(motor_axis_no,
-                   direction,
-                   (double)value,
-                   1 /* double acceleration */);
-      return TCPSIM_SEND_OK;
+  for (cmd_axis_no = first_axis; cmd_axis_no <= last_axis; cmd_axis_no++) {
+    int motor_axis_no = cmd_axis_no_to_hw(cmd_axis_no);
+    init_axis(motor_axis_no);
+    if (motor_axis_no <= 0 || motor_axis_no >= MAX_AXES) {
+      /* A port range beyond the simulator */
+      break;
     }
-  }
-  if (0 == strcmp(myarg_2, "POW")) {
-    nvals = sscanf(myarg_3, "%d", &value);
-    LOGINFO5("%s/%s:%d res=%d\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             nvals);
-    if (nvals == 1) {
-      if (!setAmplifierPercent(motor_axis_no, value)) {
-        return TCPSIM_SEND_OK;
-      }
+    if (cmd_axis_no != first_axis) {
+      cmd_buf_printf(" ");
     }
+    hw_motor_lock_axis(motor_axis_no);
+    (void)tcpsim_cmd->handle(motor_axis_no, 0);
+    hw_motor_unlock_axis(motor_axis_no);
+    cmd_send_part();
   }
-  return 0;
+  return TCPSIM_SEND_NEWLINE;
 }
 
-int cmd_TCPsim(int argc, const char *argv[])
+int cmd_TCPsim(int argc, const cmd_span_type argv[])
 {
+  const tcpsim_cmd_type *tcpsim_cmd = NULL;
   int ret = 0;
   int axis_no = 0;
-  LOGINFO5("%s/%s:%d argc=%d argv[0]=%s\n",
+  int value = 0;
+  const char *argv1 = (argc > 1) ? argv[1].ptr : "";
+  LOGINFO5("%s/%s:%d argc=%d argv[1]=%s\n",
            __FILE__, __FUNCTION__, __LINE__,
-           argc, argv[0]);
+           argc, argv1);
   /* We use a UNIX like counting:
      argc == 4
-     argv[0]  "1:MOVE 2011" (non-UNIX: the whole command line)
-     argv[1]  "1:MOVE"
-     argv[2]  "2011"
+     argv[0]  span of "1 MA 2011" (non-UNIX: the whole command line,
+              no C string)
+     argv[1]  "1"
+     argv[2]  "MA"
+     argv[3]  "2011"
   */
-  if (argc >= 2) {
+  if (argc == 3 || argc == 4) {
+    tcpsim_cmd = tcpsim_cmd_find(argv[2].ptr, argc == 4);
+  }
+  if (tcpsim_cmd) {
     int nvals;
-    nvals = sscanf(argv[1], "%d", &axis_no);
-    LOGINFO5("%s/%s:%d argv[1]=%s argc=%d nvals=%d axis_no=%d\n",
+    LOGINFO5("%s/%s:%d argv[1]=%s argv[2]=%s argv[3]=%s\n",
              __FILE__, __FUNCTION__, __LINE__,
-             argv[1], argc, nvals, axis_no);
-    if (nvals != 1 || axis_no < 1) {
-      return 0; /* Not TCPSIM */
+             argv1, argv[2].ptr, argc == 4 ? argv[3].ptr : "");
+    nvals = sscanf(argv1, "%d", &axis_no);
+    if (nvals == 1 && axis_no >= 1 && !strchr(argv1, '-')) {
+      axis_no = cmd_axis_no_to_hw(axis_no);
+      init_axis(axis_no);
+      if (argc == 4 && sscanf(argv[3].ptr, "%d", &value) != 1) {
+        ret = 0;
+      } else if (axis_no > 0 && axis_no < MAX_AXES) {
+        hw_motor_lock_axis(axis_no);
+        ret = tcpsim_cmd->handle(axis_no, value);
+        hw_motor_unlock_axis(axis_no);
+      }
+    } else {
+      ret = handle_TCPSIM_axis_list(argv1, tcpsim_cmd);
     }
   }
-
-  if (argc == 4) {
-    LOGINFO5("%s/%s:%d axis_no=%d argv[2]=%s argv[3]=%s\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             axis_no, argv[2], argv[3]);
-    ret = handle_TCPSIM_cmd4(axis_no, argv[2], argv[3]);
-  } else if (argc == 3) {
-    LOGINFO5("%s/%s:%d argv[1]=%s argv[2]=%s\n",
-             __FILE__, __FUNCTION__, __LINE__,
-             argv[1], argv[2]);
-    ret = handle_TCPSIM_cmd3(axis_no, argv[2]);
-  }
   switch (ret) {
     case TCPSIM_SEND_OK:
       cmd_buf_printf("%s\n", "OK");
@@ -216,9 +284,9 @@ int cmd_TCPsim(int argc, const char *argv[])
       cmd_buf_printf("\n");
       break;
     default:
-      LOGERR("%s/%s:%d argv[0]=%s\n",
+      LOGERR("%s/%s:%d argc=%d argv[1]=%s\n",
              __FILE__, __FUNCTION__, __LINE__,
-             argv[0]);
+             argc, argv1);
       ;
   }
   return ret;
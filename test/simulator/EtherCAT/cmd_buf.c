@@ -1,51 +1,119 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include "cmd_buf.h"
+#include "num_codec.h"
 #include "sock-util.h"
 
-static size_t buf_len = 0;
-static size_t used_len = 0;
-static char *buf = NULL;
+/* First allocation, doubled when more is needed */
+#define CMD_BUF_INITIAL_LEN 256
+/* A buffer which a large response has grown above this
+   is freed when cleared */
+#define CMD_BUF_KEEP_MAX_LEN (64 * 1024)
 
+static __thread cmd_buf_type *cur_cmd_buf;
+static __thread cmd_buf_type thread_cmd_buf;
+
+/*****************************************************************************/
+static cmd_buf_type *get_cmd_buf(void)
+{
+  return cur_cmd_buf ? cur_cmd_buf : &thread_cmd_buf;
+}
+
+/*****************************************************************************/
+/* Make room for add_len more characters and the '\0' */
+static int cmd_buf_reserve(cmd_buf_type *cmd_buf, size_t add_len)
+{
+  size_t need_len = cmd_buf->used_len + add_len + 1;
+  size_t new_len;
+  char *new_buf;
+  if (need_len <= cmd_buf->buf_len) {
+    return 0;
+  }
+  new_len = cmd_buf->buf_len ? cmd_buf->buf_len : CMD_BUF_INITIAL_LEN;
+  while (new_len < need_len) {
+    new_len *= 2;
+  }
+  new_buf = realloc(cmd_buf->buf, new_len);
+  if (!new_buf) {
+    return -1;
+  }
+  cmd_buf->buf = new_buf;
+  cmd_buf->buf_len = new_len;
+  return 0;
+}
+
+/*****************************************************************************/
+/*
+ * Replace "\n" with "\r\n" in the len characters after used_len,
+ * unless there is a '\r' already.  Done in place from the end.
+ * Returns the new length
+ */
+static int cmd_buf_add_cr(cmd_buf_type *cmd_buf, int len)
+{
+  char *txt;
+  int num_cr = 0;
+  int src_idx;
+  int dst_idx;
+
+  txt = &cmd_buf->buf[cmd_buf->used_len];
+  for (src_idx = 0; src_idx < len; src_idx++) {
+    if (txt[src_idx] == '\n' && (!src_idx || txt[src_idx - 1] != '\r')) {
+      num_cr++;
+    }
+  }
+  if (!num_cr || cmd_buf_reserve(cmd_buf, len + num_cr)) {
+    return len;
+  }
+  txt = &cmd_buf->buf[cmd_buf->used_len];
+  dst_idx = len + num_cr;
+  txt[dst_idx] = '\0';
+  for (src_idx = len - 1; src_idx >= 0; src_idx--) {
+    char c = txt[src_idx];
+    txt[--dst_idx] = c;
+    if (c == '\n' && (!src_idx || txt[src_idx - 1] != '\r')) {
+      txt[--dst_idx] = '\r';
+    }
+  }
+  return len + num_cr;
+}
 
 /*****************************************************************************/
 static int cmd_buf_vprintf_crlf (int flags, const char* format, va_list arg)
 {
-  const static size_t len = 4096;
+  cmd_buf_type *cmd_buf = get_cmd_buf();
   int add_cr = flags & PRINT_ADD_CR;
+  size_t avail_len;
+  va_list arg_copy;
+  int res;
 
-  char *buf = calloc(len,1);
-  int res = vsnprintf(buf, len-1, format, arg);
-  if (res >= 0 && !add_cr) {
-    add_to_buf(buf, res);
+  if (cmd_buf_reserve(cmd_buf, 0)) {
+    return -1;
   }
-  else if (res >= 0)
-  {
-    unsigned src_idx = 0;
-    unsigned dst_idx = 0;
-    char *buf2 = calloc(2*res, 1);
-    char oldc = 0;
-    for (src_idx=0; src_idx < res; src_idx++)
-    {
-      char c = buf[src_idx];
-      buf2[dst_idx] = c;
-#if 1
-      if ((c == '\n') && (oldc != '\r')) {
-        buf2[dst_idx++] = '\r';
-        buf2[dst_idx] = '\n';
-      }
-#else
-      (void)oldc;
-#endif
-      oldc = c;
-      dst_idx++;
+  /* Format directly into the buffer, and again if it did not fit */
+  avail_len = cmd_buf->buf_len - cmd_buf->used_len;
+  va_copy(arg_copy, arg);
+  res = vsnprintf(&cmd_buf->buf[cmd_buf->used_len], avail_len,
+                  format, arg_copy);
+  va_end(arg_copy);
+  if (res >= 0 && (size_t)res >= avail_len) {
+    if (cmd_buf_reserve(cmd_buf, res)) {
+      res = -1;
+    } else {
+      res = vsnprintf(&cmd_buf->buf[cmd_buf->used_len], res + 1,
+                      format, arg);
     }
-    add_to_buf(buf2, dst_idx);
-
-    free(buf2);
   }
-  free(buf);
+  if (res < 0) {
+    cmd_buf->buf[cmd_buf->used_len] = '\0';
+    return res;
+  }
+  if (add_cr) {
+    cmd_buf->used_len += cmd_buf_add_cr(cmd_buf, res);
+  } else {
+    cmd_buf->used_len += res;
+  }
   return res;
 }
 
@@ -72,23 +140,62 @@ void cmd_buf_printf_crlf(int add_cr, const char *format, ...)
 /*****************************************************************************/
 void add_to_buf(const char *add_txt, size_t add_len)
 {
-  if (add_len + used_len >= buf_len) {
-    buf_len = 1 + add_len + used_len; /* 1 for '\0' */
-    buf = realloc(buf, buf_len);
+  cmd_buf_type *cmd_buf = get_cmd_buf();
+  if (cmd_buf_reserve(cmd_buf, add_len)) {
+    return;
+  }
+  memcpy(&cmd_buf->buf[cmd_buf->used_len], add_txt, add_len);
+  cmd_buf->used_len += add_len;
+  cmd_buf->buf[cmd_buf->used_len] = '\0';
+}
+
+/* Formatted in place, no copy */
+void cmd_buf_add_double(double value)
+{
+  cmd_buf_type *cmd_buf = get_cmd_buf();
+  if (cmd_buf_reserve(cmd_buf, NUM_DOUBLE_BUFLEN)) {
+    return;
   }
-  memcpy(&buf[used_len], add_txt, add_len);
-  used_len += add_len;
-  buf[used_len] = '\0';
+  num_format_double(&cmd_buf->buf[cmd_buf->used_len], value);
+  cmd_buf->used_len += strlen(&cmd_buf->buf[cmd_buf->used_len]);
 }
 
 /*****************************************************************************/
 char *get_buf(void)
 {
-  return buf ? buf : "";
+  cmd_buf_type *cmd_buf = get_cmd_buf();
+  return cmd_buf->buf ? cmd_buf->buf : "";
+}
+
+/*****************************************************************************/
+size_t get_buf_len(void)
+{
+  return get_cmd_buf()->used_len;
 }
 
 /*****************************************************************************/
 void clear_buf(void)
 {
-  used_len = 0;
+  cmd_buf_type *cmd_buf = get_cmd_buf();
+  cmd_buf->used_len = 0;
+  if (cmd_buf->buf_len > CMD_BUF_KEEP_MAX_LEN) {
+    cmd_buf_free(cmd_buf);
+  } else if (cmd_buf->buf) {
+    cmd_buf->buf[0] = '\0';
+  }
+}
+
+/*****************************************************************************/
+void cmd_buf_select(cmd_buf_type *cmd_buf)
+{
+  cur_cmd_buf = cmd_buf;
+}
+
+/*****************************************************************************/
+void cmd_buf_free(cmd_buf_type *cmd_buf)
+{
+  free(cmd_buf->buf);
+  cmd_buf->buf = NULL;
+  cmd_buf->buf_len = 0;
+  cmd_buf->used_len = 0;
 }
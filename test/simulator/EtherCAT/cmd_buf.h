@@ -1,5 +1,18 @@
+#ifndef CMD_BUF_H
+#define CMD_BUF_H
 
+#include <stddef.h>
 
+/*
+ * The response to a command is collected here before it is sent.
+ * Each connection has its own; the allocation is kept between
+ * commands and grows by doubling
+ */
+typedef struct cmd_buf_type {
+  char   *buf;
+  size_t buf_len;   /* allocated */
+  size_t used_len;  /* without the '\0' */
+} cmd_buf_type;
 
 __attribute__((format (printf,2,3)))
 extern void cmd_buf_printf_crlf(int flags, const char *fmt, ...);
@@ -8,5 +21,15 @@ __attribute__((format (printf,1,2)))
 extern void cmd_buf_printf(const char *fmt, ...);
 
 void add_to_buf(const char *add_txt, size_t add_len);
+/* Shortest text which reads back as the same value */
+void cmd_buf_add_double(double value);
 char *get_buf(void);
+size_t get_buf_len(void);
 void clear_buf(void);
+
+/* The buffer used by the functions above in this thread,
+   NULL selects a buffer of the thread */
+void cmd_buf_select(cmd_buf_type *cmd_buf);
+void cmd_buf_free(cmd_buf_type *cmd_buf);
+
+#endif /* CMD_BUF_H */
@@ -1,10 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
 #include <math.h>
 #include "hw_motor.h"
+#include "motion_profile.h"
 #include "sock-util.h" /* stdlog */
+#ifdef USE_EPOLL
+#include <pthread.h>
+#endif
 
 #define NINT(f) (long)((f)>0 ? (f)+0.5 : (f)-0.5)       /* Nearest integer. */
 
@@ -22,9 +28,28 @@
 
 #define RAMPDOWNONLIMIT 3
 
+typedef struct motor_moving_type
+{
+  struct {
+    double HomeVelocity;
+    double PosVelocity;
+    double JogVelocity;
+  } velo;
+  int hitPosLimitSwitch;
+  int hitNegLimitSwitch;
+  unsigned int rampDownOnLimit;
+  unsigned int rampUpAfterStart;
+  int clipped;
+} motor_moving_type;
+
 typedef struct
 {
-  struct timeval lastPollTime;
+  uint64_t lastPollTime_ns; /* CLOCK_MONOTONIC */
+  /* The ongoing move, started at profileStart_ns */
+  motion_profile_type profile;
+  uint64_t profileStart_ns;
+  double deceleration;
+  double jerk;
 
   double amplifierPercent;
   /* What the (simulated) hardware has physically.
@@ -56,18 +81,7 @@ typedef struct
   double MotorPosWanted;
   double HomeVelocityAbsWanted;
   double MaxHomeVelocityAbs;
-  struct {
-    struct {
-      double HomeVelocity;
-      double PosVelocity;
-      double JogVelocity;
-    } velo;
-    int hitPosLimitSwitch;
-    int hitNegLimitSwitch;
-    unsigned int rampDownOnLimit;
-    unsigned int rampUpAfterStart;
-    int clipped;
-  } moving;
+  motor_moving_type moving;
   double EncoderPos;
   double ParkingPos;
   double ReverseERES;
@@ -80,9 +94,220 @@ typedef struct
 } motor_axis_type;
 
 
-static motor_axis_type motor_axis[MAX_AXES];
-static motor_axis_type motor_axis_last[MAX_AXES];
-static motor_axis_type motor_axis_reported[MAX_AXES];
+/* What was last logged of an axis, to log only changes */
+typedef struct
+{
+  motor_moving_type moving;
+  double MotorPosNow;
+  double MotorPosWanted;
+  double EncoderPos;
+} motor_axis_seen_type;
+
+int hw_motor_max_axes;
+
+/* Allocated by hw_motor_set_num_axes() */
+static motor_axis_type *motor_axis;
+static motor_axis_seen_type *motor_axis_last;
+static motor_axis_seen_type *motor_axis_reported;
+
+/*
+ * The worker threads handle the commands for different axes at the
+ * same time.  An axis is changed with its lock held, see
+ * hw_motor_lock_axis().  The other locks are taken with no axis lock
+ * held (tick_lock, clock_lock), or as the last one (init_lock)
+ */
+#ifdef USE_EPOLL
+static pthread_mutex_t *axis_lock;
+/* One tick at a time: the tick thread, or Sim.advance= */
+static pthread_mutex_t tick_lock = PTHREAD_MUTEX_INITIALIZER;
+/* The writers of the clock */
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+/* The list of the axes in use */
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+#define HW_LOCK(m)   (void)pthread_mutex_lock(m)
+#define HW_UNLOCK(m) (void)pthread_mutex_unlock(m)
+#else
+#define HW_LOCK(m)
+#define HW_UNLOCK(m)
+#endif
+
+/*
+ * Seqlocks, for what is written seldom and read often without a lock:
+ * seq is odd while the data is written.  The writers are serialized
+ * by a lock; the data is loaded and stored with atomics, a reader
+ * which raced with the writer tries again
+ */
+static unsigned seqReadBegin(const unsigned *seq)
+{
+  unsigned value;
+  while ((value = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+    ;
+  }
+  return value;
+}
+
+static int seqReadRetry(const unsigned *seq, unsigned value)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(seq, __ATOMIC_RELAXED) != value;
+}
+
+static void seqWriteBegin(unsigned *seq)
+{
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void seqWriteEnd(unsigned *seq)
+{
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+#define SEQ_LOAD(p)  __extension__ ({ __typeof__(*(p)) v_;              \
+      __atomic_load((p), &v_, __ATOMIC_RELAXED); v_; })
+#define SEQ_STORE(p, value) do { __typeof__(*(p)) v_ = (value);         \
+    __atomic_store((p), &v_, __ATOMIC_RELAXED); } while (0)
+
+/*
+ * The clock of the simulation runs clock_scale times faster than the
+ * real time, counted from the last change of the scale.
+ * 0 stops it, then it moves with hw_motor_clock_advance() only
+ */
+static unsigned clock_seq;
+static double clock_scale = 1.0;
+static uint64_t clock_base_real_ns;
+static uint64_t clock_base_ns;
+
+/*
+ * A time which does not jump when the clock is set, in nanoseconds
+ */
+static uint64_t get_real_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if (!clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+  }
+#endif
+  {
+    struct timeval tv;
+    (void)gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_usec * 1000;
+  }
+}
+
+/* The time of the simulation, in nanoseconds */
+static uint64_t get_now_ns(void)
+{
+  double scale;
+  uint64_t base_real_ns;
+  uint64_t base_ns;
+  uint64_t real_ns;
+  unsigned seq;
+
+  do {
+    seq = seqReadBegin(&clock_seq);
+    scale = SEQ_LOAD(&clock_scale);
+    base_real_ns = SEQ_LOAD(&clock_base_real_ns);
+    base_ns = SEQ_LOAD(&clock_base_ns);
+  } while (seqReadRetry(&clock_seq, seq));
+  real_ns = get_real_ns() - base_real_ns;
+  if (scale == 1.0) {
+    return base_ns + real_ns;
+  }
+  return base_ns + (uint64_t)((double)real_ns * scale);
+}
+
+/* Seconds since the start of the ongoing move */
+static double getProfileTime(int axis_no, uint64_t time_ns)
+{
+  return (double)(int64_t)(time_ns - motor_axis[axis_no].profileStart_ns) / 1e9;
+}
+
+static void startProfile(int axis_no)
+{
+  motor_axis[axis_no].profileStart_ns = get_now_ns();
+  motor_axis[axis_no].lastPollTime_ns = motor_axis[axis_no].profileStart_ns;
+}
+
+static double getDeceleration(int axis_no, double acceleration)
+{
+  if (motor_axis[axis_no].deceleration > 0) {
+    return motor_axis[axis_no].deceleration;
+  }
+  return acceleration;
+}
+
+/*
+ * With a tick thread, hw_motor_tick() moves the axes, and the getters
+ * of the status return what was published last, without side effects
+ * and without a lock.  The snapshot of an axis is a seqlock, written
+ * with the lock of the axis held: by the tick, by the moves, and when
+ * the lock is released after a command
+ */
+typedef struct motor_snapshot_type {
+  unsigned seq;
+  motor_status_type status;
+} motor_snapshot_type;
+
+/* rampUpAfterStart and rampDownOnLimit count polls.  When ticking,
+   they count steps of this length */
+#define RAMP_STEP_MS 100
+
+static motor_snapshot_type *motor_snapshot;
+static char *axis_init_done;
+/* The axes which are in use, in the order of their first use */
+static int *axis_init_list;
+static int num_axes_init;
+static int ticking;
+static uint64_t lastRampStep_ns;
+
+static void publishSnapshot(int axis_no);
+static int getAmplifierOnNow(int axis_no);
+
+static void readSnapshot(int axis_no, motor_status_type *status)
+{
+  motor_snapshot_type *src = &motor_snapshot[axis_no];
+  unsigned seq;
+  do {
+    seq = seqReadBegin(&src->seq);
+    status->MotorPos = SEQ_LOAD(&src->status.MotorPos);
+    status->EncoderPos = SEQ_LOAD(&src->status.EncoderPos);
+    status->velocity = SEQ_LOAD(&src->status.velocity);
+    status->moving = SEQ_LOAD(&src->status.moving);
+    status->negLimitSwitch = SEQ_LOAD(&src->status.negLimitSwitch);
+    status->posLimitSwitch = SEQ_LOAD(&src->status.posLimitSwitch);
+    status->amplifierOn = SEQ_LOAD(&src->status.amplifierOn);
+    status->homeSwitch = SEQ_LOAD(&src->status.homeSwitch);
+    status->homed = SEQ_LOAD(&src->status.homed);
+    status->nErrorId = SEQ_LOAD(&src->status.nErrorId);
+  } while (seqReadRetry(&src->seq, seq));
+}
+
+int hw_motor_ticking(void)
+{
+  return __atomic_load_n(&ticking, __ATOMIC_ACQUIRE);
+}
+
+void hw_motor_lock_axis(int axis_no)
+{
+  if (axis_no < 0 || axis_no >= MAX_AXES) {
+    return;
+  }
+  HW_LOCK(&axis_lock[axis_no]);
+}
+
+void hw_motor_unlock_axis(int axis_no)
+{
+  if (axis_no < 0 || axis_no >= MAX_AXES) {
+    return;
+  }
+  /* What the command has changed, like the amplifier or the error */
+  if (axis_init_done[axis_no]) {
+    publishSnapshot(axis_no);
+  }
+  HW_UNLOCK(&axis_lock[axis_no]);
+}
 
 static void recalculate_pos(int axis_no, int nCmdData)
 {
@@ -141,7 +366,6 @@ void hw_motor_init(int axis_no,
                    const struct motor_init_values *pMotor_init_values,
                    size_t motor_init_len)
 {
-  static char init_done[MAX_AXES];
   if (axis_no >= MAX_AXES || axis_no < 0) {
     return;
   }
@@ -154,7 +378,11 @@ void hw_motor_init(int axis_no,
       return;
   }
 
-  if (!init_done[axis_no]) {
+  if (__atomic_load_n(&axis_init_done[axis_no], __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  hw_motor_lock_axis(axis_no);
+  if (!axis_init_done[axis_no]) {
     double ReverseERES = pMotor_init_values->ReverseERES;
     double ParkingPos = pMotor_init_values->ParkingPos;
     double MaxHomeVelocityAbs = pMotor_init_values->MaxHomeVelocityAbs;
@@ -204,8 +432,14 @@ void hw_motor_init(int axis_no,
     motor_axis[axis_no].EncoderPos = getEncoderPosFromMotorPos(axis_no, motor_axis[axis_no].MotorPosNow);
     motor_axis_last[axis_no].EncoderPos  = motor_axis[axis_no].EncoderPos;
     motor_axis_last[axis_no].MotorPosNow = motor_axis[axis_no].MotorPosNow;
-    init_done[axis_no] = 1;
+    publishSnapshot(axis_no);
+    __atomic_store_n(&axis_init_done[axis_no], 1, __ATOMIC_RELEASE);
+    HW_LOCK(&init_lock);
+    axis_init_list[num_axes_init] = axis_no;
+    __atomic_store_n(&num_axes_init, num_axes_init + 1, __ATOMIC_RELEASE);
+    HW_UNLOCK(&init_lock);
   }
+  HW_UNLOCK(&axis_lock[axis_no]);
 }
 
 
@@ -285,6 +519,13 @@ void setMaxHomeVelocityAbs(int axis_no, double value)
   motor_axis[axis_no].MaxHomeVelocityAbs = value;
 }
 
+void setMotorProfile(int axis_no, double deceleration, double jerk)
+{
+  AXIS_CHECK_RETURN(axis_no);
+  motor_axis[axis_no].deceleration = deceleration;
+  motor_axis[axis_no].jerk = jerk;
+}
+
 static double getMotorVelocityInt(int axis_no)
 {
   if (motor_axis[axis_no].moving.velo.JogVelocity) return motor_axis[axis_no].moving.velo.JogVelocity;
@@ -293,25 +534,38 @@ static double getMotorVelocityInt(int axis_no)
   return 0;
 }
 
-double getMotorVelocity(int axis_no)
+static double getMotorVelocityNow(int axis_no)
 {
   double velocity;
-  AXIS_CHECK_RETURN_ZERO(axis_no);
   if (motor_axis[axis_no].moving.rampUpAfterStart) {
     return 0;
   }
   velocity = getMotorVelocityInt(axis_no);
+  if (velocity) {
+    /* Where the move is on its profile */
+    velocity = motion_profile_vel(&motor_axis[axis_no].profile,
+                                  getProfileTime(axis_no,
+                                                 motor_axis[axis_no].lastPollTime_ns));
+  }
   return velocity;
 }
 
-int isMotorMoving(int axis_no)
+double getMotorVelocity(int axis_no)
 {
   AXIS_CHECK_RETURN_ZERO(axis_no);
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.velocity);
+  }
+  return getMotorVelocityNow(axis_no);
+}
+
+/* Without counting down rampDownOnLimit */
+static int isMotorMovingNow(int axis_no)
+{
   if (motor_axis[axis_no].bManualSimulatorMode) {
     return 0;
   }
   if (motor_axis[axis_no].moving.rampDownOnLimit) {
-    motor_axis[axis_no].moving.rampDownOnLimit--;
     return 1;
   }
   if (motor_axis[axis_no].moving.rampUpAfterStart) {
@@ -320,6 +574,21 @@ int isMotorMoving(int axis_no)
   return getMotorVelocityInt(axis_no) ? 1 : 0;
 }
 
+int isMotorMoving(int axis_no)
+{
+  int moving;
+  AXIS_CHECK_RETURN_ZERO(axis_no);
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.moving);
+  }
+  moving = isMotorMovingNow(axis_no);
+  if (!motor_axis[axis_no].bManualSimulatorMode &&
+      motor_axis[axis_no].moving.rampDownOnLimit) {
+    motor_axis[axis_no].moving.rampDownOnLimit--;
+  }
+  return moving;
+}
+
 int getAxisDone(int axis_no)
 {
   AXIS_CHECK_RETURN_ZERO(axis_no);
@@ -328,18 +597,27 @@ int getAxisDone(int axis_no)
   return ret;
 }
 
+static int getAxisHomeNow(int axis_no)
+{
+  return motor_axis[axis_no].MotorPosNow == motor_axis[axis_no].HomeProcPos;
+}
+
 int getAxisHome(int axis_no)
 {
   AXIS_CHECK_RETURN_ZERO(axis_no);
-  int ret;
-  ret = (motor_axis[axis_no].MotorPosNow == motor_axis[axis_no].HomeProcPos);
-  return ret;
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.homeSwitch);
+  }
+  return getAxisHomeNow(axis_no);
 }
 
 int getAxisHomed(int axis_no)
 {
   int ret;
   AXIS_CHECK_RETURN_ZERO(axis_no);
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.homed);
+  }
   ret = motor_axis[axis_no].homed;
   return ret;
 }
@@ -461,7 +739,7 @@ int setMRES_23(int axis_no, double value)
           __FILE__, __FUNCTION__, __LINE__, axis_no,
           value);
   AXIS_CHECK_RETURN_ERROR(axis_no);
-  if (getAmplifierOn(axis_no))
+  if (getAmplifierOnNow(axis_no))
     return 1;
   motor_axis[axis_no].MRES_23 = value;
   return 0;
@@ -485,7 +763,7 @@ int setMRES_24(int axis_no, double value)
           __FILE__, __FUNCTION__, __LINE__, axis_no,
           value);
   AXIS_CHECK_RETURN_ERROR(axis_no);
-  if (getAmplifierOn(axis_no))
+  if (getAmplifierOnNow(axis_no))
     return 1;
   motor_axis[axis_no].MRES_24 = value;
   return 0;
@@ -594,7 +872,9 @@ void setHWhomeSwitchpos(int axis_no, double value)
 
 static void simulateMotion(int axis_no)
 {
-  struct timeval timeNow;
+  uint64_t timeNow_ns;
+  double deltaPos; /* along the profile since the last poll */
+  double tNow;
   double velocity;
   int clipped = 0;
 
@@ -602,15 +882,17 @@ static void simulateMotion(int axis_no)
   if (getManualSimulatorMode(axis_no)) return;
 
   if (motor_axis[axis_no].moving.rampUpAfterStart) {
-    fprintf(stdlog,
-            "%s/%s:%d axis_no=%d rampUpAfterStart=%d\n",
-            __FILE__, __FUNCTION__, __LINE__,
-            axis_no,
-            motor_axis[axis_no].moving.rampUpAfterStart);
+    if (!hw_motor_ticking()) {
+      fprintf(stdlog,
+              "%s/%s:%d axis_no=%d rampUpAfterStart=%d\n",
+              __FILE__, __FUNCTION__, __LINE__,
+              axis_no,
+              motor_axis[axis_no].moving.rampUpAfterStart);
+    }
     motor_axis[axis_no].moving.rampUpAfterStart--;
     return;
   }
-  velocity = getMotorVelocity(axis_no);
+  velocity = getMotorVelocityInt(axis_no);
 
   if (motor_axis[axis_no].amplifierPercent < 100) {
     if (velocity) {
@@ -620,14 +902,18 @@ static void simulateMotion(int axis_no)
     }
   }
 
-  gettimeofday(&timeNow, NULL);
+  timeNow_ns = get_now_ns();
+  tNow = getProfileTime(axis_no, timeNow_ns);
+  deltaPos = motion_profile_pos(&motor_axis[axis_no].profile, tNow) -
+    motion_profile_pos(&motor_axis[axis_no].profile,
+                       getProfileTime(axis_no,
+                                      motor_axis[axis_no].lastPollTime_ns));
 
   if (motor_axis[axis_no].moving.velo.JogVelocity) {
     clipped = soft_limits_clip(axis_no, velocity);
     if (!clipped) {
       /* Simulate jogging  */
-      motor_axis[axis_no].MotorPosNow += motor_axis[axis_no].moving.velo.JogVelocity *
-        (timeNow.tv_sec - motor_axis[axis_no].lastPollTime.tv_sec);
+      motor_axis[axis_no].MotorPosNow += deltaPos;
     }
   }
 
@@ -635,9 +921,9 @@ static void simulateMotion(int axis_no)
     clipped = soft_limits_clip(axis_no, velocity);
     if (!clipped) {
       /* Simulate a move to postion */
-      motor_axis[axis_no].MotorPosNow += motor_axis[axis_no].moving.velo.PosVelocity *
-        (timeNow.tv_sec - motor_axis[axis_no].lastPollTime.tv_sec);
-      if (((motor_axis[axis_no].moving.velo.PosVelocity > 0) &&
+      motor_axis[axis_no].MotorPosNow += deltaPos;
+      if (motion_profile_done(&motor_axis[axis_no].profile, tNow) ||
+          ((motor_axis[axis_no].moving.velo.PosVelocity > 0) &&
            (motor_axis[axis_no].MotorPosNow > motor_axis[axis_no].MotorPosWanted)) ||
           ((motor_axis[axis_no].moving.velo.PosVelocity < 0) &&
            (motor_axis[axis_no].MotorPosNow < motor_axis[axis_no].MotorPosWanted))) {
@@ -649,10 +935,10 @@ static void simulateMotion(int axis_no)
   }
   if (motor_axis[axis_no].moving.velo.HomeVelocity) {
     /* Simulate move to home */
-    motor_axis[axis_no].MotorPosNow += motor_axis[axis_no].moving.velo.HomeVelocity *
-      (timeNow.tv_sec - motor_axis[axis_no].lastPollTime.tv_sec);
+    motor_axis[axis_no].MotorPosNow += deltaPos;
 
-    if (((motor_axis[axis_no].moving.velo.HomeVelocity > 0) &&
+    if (motion_profile_done(&motor_axis[axis_no].profile, tNow) ||
+        ((motor_axis[axis_no].moving.velo.HomeVelocity > 0) &&
          (motor_axis[axis_no].MotorPosNow > motor_axis[axis_no].HomeProcPos)) ||
         ((motor_axis[axis_no].moving.velo.HomeVelocity < 0) &&
          (motor_axis[axis_no].MotorPosNow < motor_axis[axis_no].HomeProcPos))) {
@@ -665,12 +951,14 @@ static void simulateMotion(int axis_no)
     motor_axis[axis_no].homed = 1;
   }
 
-  motor_axis[axis_no].lastPollTime = timeNow;
+  motor_axis[axis_no].lastPollTime_ns = timeNow_ns;
   clipped |= hard_limits_clip(axis_no, velocity);
 
-  /* Compare moving to see if there is anything new */
+  /* Compare moving to see if there is anything new.
+     The tick moves the axes often, then only starts and stops are logged */
   if (memcmp(&motor_axis_last[axis_no].moving, &motor_axis[axis_no].moving, sizeof(motor_axis[axis_no].moving)) ||
-      motor_axis_last[axis_no].MotorPosNow     != motor_axis[axis_no].MotorPosNow ||
+      (!hw_motor_ticking() &&
+       motor_axis_last[axis_no].MotorPosNow != motor_axis[axis_no].MotorPosNow) ||
       motor_axis_last[axis_no].MotorPosWanted  != motor_axis[axis_no].MotorPosWanted ||
       clipped) {
     fprintf(stdlog,
@@ -683,9 +971,11 @@ static void simulateMotion(int axis_no)
             motor_axis[axis_no].moving.velo.PosVelocity,
             motor_axis[axis_no].moving.velo.HomeVelocity,
             motor_axis[axis_no].moving.rampDownOnLimit,
-            getAxisHome(axis_no),
+            getAxisHomeNow(axis_no),
             motor_axis[axis_no].MotorPosNow);
-    memcpy(&motor_axis_last[axis_no], &motor_axis[axis_no], sizeof(motor_axis[axis_no]));
+    motor_axis_last[axis_no].moving = motor_axis[axis_no].moving;
+    motor_axis_last[axis_no].MotorPosNow = motor_axis[axis_no].MotorPosNow;
+    motor_axis_last[axis_no].MotorPosWanted = motor_axis[axis_no].MotorPosWanted;
   }
   /*
     homing against a limit switch does not clip,
@@ -700,10 +990,8 @@ static void simulateMotion(int axis_no)
 
 }
 
-double getMotorPos(int axis_no)
+static double getMotorPosNow(int axis_no)
 {
-  AXIS_CHECK_RETURN_ZERO(axis_no);
-  simulateMotion(axis_no);
   /* simulate EncoderPos */
   motor_axis[axis_no].EncoderPos = getEncoderPosFromMotorPos(axis_no, motor_axis[axis_no].MotorPosNow);
   if (motor_axis[axis_no].MRES_23 && motor_axis[axis_no].MRES_24) {
@@ -717,6 +1005,16 @@ double getMotorPos(int axis_no)
   return motor_axis[axis_no].MotorPosNow;
 }
 
+double getMotorPos(int axis_no)
+{
+  AXIS_CHECK_RETURN_ZERO(axis_no);
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.MotorPos);
+  }
+  simulateMotion(axis_no);
+  return getMotorPosNow(axis_no);
+}
+
 void setMotorPos(int axis_no, double value)
 {
   AXIS_CHECK_RETURN(axis_no);
@@ -727,11 +1025,15 @@ void setMotorPos(int axis_no, double value)
   /* simulate EncoderPos */
   motor_axis[axis_no].MotorPosNow = value;
   motor_axis[axis_no].EncoderPos = getEncoderPosFromMotorPos(axis_no, motor_axis[axis_no].MotorPosNow);
+  publishSnapshot(axis_no);
 }
 
 double getEncoderPos(int axis_no)
 {
   AXIS_CHECK_RETURN_ZERO(axis_no);
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.EncoderPos);
+  }
   (void)getMotorPos(axis_no);
   if (motor_axis_reported[axis_no].EncoderPos != motor_axis[axis_no].EncoderPos) {
     fprintf(stdlog, "%s/%s:%d axis_no=%d EncoderPos=%g\n",
@@ -743,6 +1045,61 @@ double getEncoderPos(int axis_no)
   return motor_axis[axis_no].EncoderPos;
 }
 
+/* With the lock of the axis held */
+static void publishSnapshot(int axis_no)
+{
+  motor_snapshot_type *dst = &motor_snapshot[axis_no];
+  motor_status_type status;
+
+  status.MotorPos = getMotorPosNow(axis_no);
+  status.EncoderPos = motor_axis[axis_no].EncoderPos;
+  status.velocity = getMotorVelocityNow(axis_no);
+  status.moving = isMotorMovingNow(axis_no);
+  status.negLimitSwitch =
+    motor_axis[axis_no].definedLowHardLimitPos &&
+    (motor_axis[axis_no].MotorPosNow <= motor_axis[axis_no].lowHardLimitPos);
+  status.posLimitSwitch =
+    (motor_axis[axis_no].MotorPosNow >= motor_axis[axis_no].highHardLimitPos);
+  status.amplifierOn = getAmplifierOnNow(axis_no);
+  status.homeSwitch = getAxisHomeNow(axis_no);
+  status.homed = motor_axis[axis_no].homed;
+  status.nErrorId = motor_axis[axis_no].nErrorId;
+
+  seqWriteBegin(&dst->seq);
+  SEQ_STORE(&dst->status.MotorPos, status.MotorPos);
+  SEQ_STORE(&dst->status.EncoderPos, status.EncoderPos);
+  SEQ_STORE(&dst->status.velocity, status.velocity);
+  SEQ_STORE(&dst->status.moving, status.moving);
+  SEQ_STORE(&dst->status.negLimitSwitch, status.negLimitSwitch);
+  SEQ_STORE(&dst->status.posLimitSwitch, status.posLimitSwitch);
+  SEQ_STORE(&dst->status.amplifierOn, status.amplifierOn);
+  SEQ_STORE(&dst->status.homeSwitch, status.homeSwitch);
+  SEQ_STORE(&dst->status.homed, status.homed);
+  SEQ_STORE(&dst->status.nErrorId, status.nErrorId);
+  seqWriteEnd(&dst->seq);
+}
+
+void getMotorStatus(int axis_no, motor_status_type *status)
+{
+  memset(status, 0, sizeof(*status));
+  AXIS_CHECK_RETURN(axis_no);
+  if (hw_motor_ticking()) {
+    readSnapshot(axis_no, status);
+    return;
+  }
+  /* getMotorPos must be first, it calls simulateMotion() */
+  status->MotorPos = getMotorPos(axis_no);
+  status->EncoderPos = motor_axis[axis_no].EncoderPos;
+  status->amplifierOn = getAmplifierOn(axis_no);
+  status->posLimitSwitch = getPosLimitSwitch(axis_no);
+  status->negLimitSwitch = getNegLimitSwitch(axis_no);
+  status->homeSwitch = getAxisHome(axis_no);
+  status->nErrorId = get_nErrorId(axis_no);
+  status->velocity = getMotorVelocity(axis_no);
+  status->homed = getAxisHomed(axis_no);
+  status->moving = isMotorMoving(axis_no);
+}
+
 /* Stop the ongoing motion (like JOG),
    to be able to start a new one (like HOME)
 */
@@ -759,6 +1116,7 @@ void StopInternal_fl(int axis_no, const char *file, int line_no)
          sizeof(motor_axis[axis_no].moving.velo));
   /* Restore the ramp down */
   motor_axis[axis_no].moving.rampDownOnLimit = rampDownOnLimit;
+  publishSnapshot(axis_no);
 }
 
 
@@ -795,7 +1153,6 @@ int movePosition(int axis_no,
           acceleration,
           motor_axis[axis_no].MotorPosNow);
   StopInternal(axis_no);
-  gettimeofday(&motor_axis[axis_no].lastPollTime, NULL);
 
   if (relative) {
     position += motor_axis[axis_no].MotorPosNow;
@@ -814,6 +1171,12 @@ int movePosition(int axis_no,
   }
   motor_axis[axis_no].MotorPosWanted = position;
 
+  startProfile(axis_no);
+  motion_profile_move(&motor_axis[axis_no].profile,
+                      position - motor_axis[axis_no].MotorPosNow,
+                      max_velocity, acceleration,
+                      getDeceleration(axis_no, acceleration),
+                      motor_axis[axis_no].jerk);
   if (position > motor_axis[axis_no].MotorPosNow) {
     motor_axis[axis_no].moving.velo.PosVelocity = max_velocity;
     motor_axis[axis_no].moving.rampUpAfterStart = motor_axis[axis_no].defRampUpAfterStart;
@@ -823,6 +1186,7 @@ int movePosition(int axis_no,
   } else {
     motor_axis[axis_no].moving.velo.PosVelocity = 0;
   }
+  publishSnapshot(axis_no);
 
   return 0;
 }
@@ -895,7 +1259,12 @@ int moveHomeProc(int axis_no,
           acceleration);
   StopInternal(axis_no);
   motor_axis[axis_no].homed = 0; /* Not homed any more */
-  gettimeofday(&motor_axis[axis_no].lastPollTime, NULL);
+  startProfile(axis_no);
+  motion_profile_move(&motor_axis[axis_no].profile,
+                      position - motor_axis[axis_no].MotorPosNow,
+                      velocity, acceleration,
+                      getDeceleration(axis_no, acceleration),
+                      motor_axis[axis_no].jerk);
 
   if (position > motor_axis[axis_no].MotorPosNow) {
     motor_axis[axis_no].moving.velo.HomeVelocity = velocity;
@@ -907,6 +1276,7 @@ int moveHomeProc(int axis_no,
     motor_axis[axis_no].moving.velo.HomeVelocity = 0;
     motor_axis[axis_no].homed = 1; /* homed again */
   }
+  publishSnapshot(axis_no);
 
   return 0;
 };
@@ -957,8 +1327,12 @@ int moveVelocity(int axis_no,
   if (direction < 0) {
     velocity = -velocity;
   }
+  startProfile(axis_no);
+  motion_profile_jog(&motor_axis[axis_no].profile, velocity,
+                     acceleration, motor_axis[axis_no].jerk);
   motor_axis[axis_no].moving.velo.JogVelocity = velocity;
   motor_axis[axis_no].moving.rampUpAfterStart = motor_axis[axis_no].defRampUpAfterStart;
+  publishSnapshot(axis_no);
   return 0;
 };
 
@@ -975,12 +1349,20 @@ int setAmplifierPercent(int axis_no, int percent)
   return 0;
 }
 
-int getAmplifierOn(int axis_no)
+static int getAmplifierOnNow(int axis_no)
 {
   if (motor_axis[axis_no].amplifierPercent == 100) return 1;
   return 0;
 }
 
+int getAmplifierOn(int axis_no)
+{
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.amplifierOn);
+  }
+  return getAmplifierOnNow(axis_no);
+}
+
 
 void getAxisDebugInfoData(int axis_no, char *buf, size_t maxlen)
 {
@@ -995,7 +1377,7 @@ void getAxisDebugInfoData(int axis_no, char *buf, size_t maxlen)
            motor_axis[axis_no].MotorPosNow);
 }
 
-int getNegLimitSwitch(int axis_no)
+static int updateNegLimitSwitch(int axis_no)
 {
   int clipped =
     motor_axis[axis_no].definedLowHardLimitPos &&
@@ -1018,7 +1400,7 @@ int getNegLimitSwitch(int axis_no)
   return clipped;
 }
 
-int getPosLimitSwitch(int axis_no)
+static int updatePosLimitSwitch(int axis_no)
 {
   int clipped =
     (motor_axis[axis_no].MotorPosNow >= motor_axis[axis_no].highHardLimitPos);
@@ -1040,15 +1422,33 @@ int getPosLimitSwitch(int axis_no)
   return clipped;
 }
 
+int getNegLimitSwitch(int axis_no)
+{
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.negLimitSwitch);
+  }
+  return updateNegLimitSwitch(axis_no);
+}
+
+int getPosLimitSwitch(int axis_no)
+{
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.posLimitSwitch);
+  }
+  return updatePosLimitSwitch(axis_no);
+}
+
 int get_bError(int axis_no)
 {
-  AXIS_CHECK_RETURN_ZERO(axis_no);
-  return motor_axis[axis_no].nErrorId ? 1 : 0;
+  return get_nErrorId(axis_no) ? 1 : 0;
 }
 
 int get_nErrorId(int axis_no)
 {
   AXIS_CHECK_RETURN_ZERO(axis_no);
+  if (hw_motor_ticking()) {
+    return SEQ_LOAD(&motor_snapshot[axis_no].status.nErrorId);
+  }
   return motor_axis[axis_no].nErrorId;
 }
 
@@ -1124,4 +1524,125 @@ void setAmplifierLockedToBeOff(int axis_no, int value)
   motor_axis[axis_no].amplifierLockedToBeOff = value;
 }
 
+/*
+ * Move all axes to the current time, and publish their snapshots.
+ * One axis at a time is locked, the commands for the others go on
+ */
+void hw_motor_tick(void)
+{
+  uint64_t now_ns;
+  int ramp_step;
+  int num_axes;
+  int i;
+
+  HW_LOCK(&tick_lock);
+  now_ns = get_now_ns();
+  ramp_step = now_ns - lastRampStep_ns >= (uint64_t)RAMP_STEP_MS * 1000000;
+  if (ramp_step) {
+    lastRampStep_ns = now_ns;
+  }
+  /* Only the axes in use, the others may be many */
+  num_axes = __atomic_load_n(&num_axes_init, __ATOMIC_ACQUIRE);
+  for (i = 0; i < num_axes; i++) {
+    int axis_no = axis_init_list[i];
+    HW_LOCK(&axis_lock[axis_no]);
+    /* rampUpAfterStart counts steps, not ticks */
+    if (!motor_axis[axis_no].moving.rampUpAfterStart || ramp_step) {
+      simulateMotion(axis_no);
+    }
+    (void)updateNegLimitSwitch(axis_no);
+    (void)updatePosLimitSwitch(axis_no);
+    publishSnapshot(axis_no);
+    if (ramp_step && !motor_axis[axis_no].bManualSimulatorMode &&
+        motor_axis[axis_no].moving.rampDownOnLimit) {
+      motor_axis[axis_no].moving.rampDownOnLimit--;
+    }
+    HW_UNLOCK(&axis_lock[axis_no]);
+  }
+  /* The getters use the snapshots once all of them are published */
+  __atomic_store_n(&ticking, 1, __ATOMIC_RELEASE);
+  HW_UNLOCK(&tick_lock);
+}
+
+void hw_motor_set_clock_scale(double scale)
+{
+  uint64_t now_ns;
+  if (scale < 0) {
+    return;
+  }
+  HW_LOCK(&clock_lock);
+  now_ns = get_now_ns();
+  seqWriteBegin(&clock_seq);
+  SEQ_STORE(&clock_base_ns, now_ns);
+  SEQ_STORE(&clock_base_real_ns, get_real_ns());
+  SEQ_STORE(&clock_scale, scale);
+  seqWriteEnd(&clock_seq);
+  HW_UNLOCK(&clock_lock);
+  fprintf(stdlog, "%s/%s:%d clock_scale=%g\n",
+          __FILE__, __FUNCTION__, __LINE__, scale);
+}
+
+double hw_motor_get_clock_scale(void)
+{
+  return SEQ_LOAD(&clock_scale);
+}
+
+int hw_motor_clock_advance(double ms)
+{
+  HW_LOCK(&clock_lock);
+  if (clock_scale || ms < 0) {
+    HW_UNLOCK(&clock_lock);
+    return -1;
+  }
+  seqWriteBegin(&clock_seq);
+  SEQ_STORE(&clock_base_ns, clock_base_ns + (uint64_t)(ms * 1000000));
+  seqWriteEnd(&clock_seq);
+  HW_UNLOCK(&clock_lock);
+  if (hw_motor_ticking()) {
+    /* Publish the new positions now, not with the next tick */
+    hw_motor_tick();
+  }
+  return 0;
+}
 
+int hw_motor_set_num_axes(int num_axes)
+{
+  int max_axes = num_axes + 1;
+  if (num_axes < 1 || motor_axis) {
+    return -1;
+  }
+  motor_axis = calloc(max_axes, sizeof(*motor_axis));
+  motor_axis_last = calloc(max_axes, sizeof(*motor_axis_last));
+  motor_axis_reported = calloc(max_axes, sizeof(*motor_axis_reported));
+  motor_snapshot = calloc(max_axes, sizeof(*motor_snapshot));
+  axis_init_done = calloc(max_axes, sizeof(*axis_init_done));
+  axis_init_list = calloc(max_axes, sizeof(*axis_init_list));
+  if (!motor_axis || !motor_axis_last || !motor_axis_reported ||
+      !motor_snapshot || !axis_init_done || !axis_init_list) {
+    return -1;
+  }
+#ifdef USE_EPOLL
+  axis_lock = calloc(max_axes, sizeof(*axis_lock));
+  if (!axis_lock) {
+    return -1;
+  }
+  {
+    /* Recursive: a command may call the functions which lock the axis */
+    pthread_mutexattr_t attr;
+    int i;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (i = 0; i < max_axes; i++) {
+      pthread_mutex_init(&axis_lock[i], &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+  }
+#endif
+  hw_motor_max_axes = max_axes;
+  fprintf(stdlog, "%s/%s:%d num_axes=%d bytes/axis=%u\n",
+          __FILE__, __FUNCTION__, __LINE__, num_axes,
+          (unsigned)(sizeof(*motor_axis) + sizeof(*motor_axis_last) +
+                     sizeof(*motor_axis_reported) + sizeof(*motor_snapshot) +
+                     sizeof(*axis_init_done) + sizeof(*axis_init_list)));
+  return 0;
+}
@@ -2,8 +2,12 @@
 #define MOTOR_H
 
 #include <errno.h>
-/* Axis 0 is not used, we use 1..8 */
-#define MAX_AXES 9
+/*
+ * Axis 0 is not used, we use 1..num_axes: MAX_AXES is num_axes + 1.
+ * It is 0 until hw_motor_set_num_axes() has been called at startup
+ */
+extern int hw_motor_max_axes;
+#define MAX_AXES hw_motor_max_axes
 #define AXIS_CHECK_RETURN(_axis) {init_axis(_axis); if (((_axis) <= 0) || ((_axis) >=MAX_AXES)) return;}
 #define AXIS_CHECK_RETURN_ZERO(_axis) {init_axis(_axis); if (((_axis) <= 0) || ((_axis) >=MAX_AXES)) return 0;}
 #define AXIS_CHECK_RETURN_ERROR(_axis) {init_axis(_axis); if (((_axis) <= 0) || ((_axis) >=MAX_AXES)) return (-1);}
@@ -27,6 +31,9 @@ int getAxisHome(int axis_no);
 int getAxisHomed(int axis_no);
 void setAxisHomed(int axis_no, int value);
 
+/* Allocate the axes 1..num_axes, once at startup.  -1 on error */
+int hw_motor_set_num_axes(int num_axes);
+
 static void init_axis(int);
 void hw_motor_init(int axis_no,
                    const struct motor_init_values *pMotor_init_values,
@@ -36,12 +43,61 @@ void hw_motor_init(int axis_no,
 void setMotorParkingPosition(int axis_no, double value);
 void setHomePos(int axis_no, double value);
 void setMaxHomeVelocityAbs(int axis_no, double value);
+/*
+ * The deceleration of the following moves in units/s^2,
+ * 0 decelerates like the move accelerates.
+ * jerk in units/s^3: 0 is a trapezoid, otherwise an S-curve
+ */
+void setMotorProfile(int axis_no, double deceleration, double jerk);
 void setMotorReverseERES(int axis_no, double value);
 
 
 double getMotorVelocity(int axis_no);
 int isMotorMoving(int axis_no);
 
+/*
+ * Move all axes to the current time.  Once it has been called,
+ * the getters of the status return what was published last,
+ * without a lock, instead of moving the axis themselves
+ */
+void hw_motor_tick(void);
+int  hw_motor_ticking(void);
+
+/*
+ * The commands for an axis run with its lock held, the commands for
+ * other axes may run at the same time.  The lock may be taken again
+ * by the same thread.  Unlocking publishes what the command changed.
+ * Axis 0, for what is not per axis, has a lock too; unknown axes are
+ * ignored
+ */
+void hw_motor_lock_axis(int axis_no);
+void hw_motor_unlock_axis(int axis_no);
+
+/* The status of an axis, read in one go */
+typedef struct motor_status_type {
+  double MotorPos;
+  double EncoderPos;
+  double velocity;
+  int    moving;
+  int    negLimitSwitch;
+  int    posLimitSwitch;
+  int    amplifierOn;
+  int    homeSwitch;
+  int    homed;
+  int    nErrorId;
+} motor_status_type;
+
+void getMotorStatus(int axis_no, motor_status_type *status);
+
+/*
+ * The clock of the simulation runs scale times faster than the real
+ * time, 1 is the real time.  0 stops it: then it moves only with
+ * hw_motor_clock_advance(), which returns -1 if the clock runs
+ */
+void   hw_motor_set_clock_scale(double scale);
+double hw_motor_get_clock_scale(void);
+int    hw_motor_clock_advance(double ms);
+
 void setHWlowPos (int axis_no, double value);
 void setHWhighPos(int axis_no, double value);
 void setHWhomeSwitchpos(int axis_no, double value);
@@ -96,7 +152,7 @@ int movePosition(int axis_no,
  *                the switch and return from the other side with min_velocity
  *  nCmdData      The homig procedure as described in a separate document
  *  max_velocity: >0 velocity after acceleration has been done
- *  acceleration: time in seconds to reach max_velocity
+ *  acceleration: in units/s^2, 0 reaches max_velocity at once
  *
  *  return value: 0 == OK,
  *                error codes and error handling needs to be defined
@@ -115,7 +171,7 @@ int moveHomeProc(int axis_no,
  *                should be reached (Which means that we may run over
  *                the switch and return from the other side with min_velocity
  *  max_velocity: >0 velocity after acceleration has been done
- *  acceleration: time in seconds to reach max_velocity
+ *  acceleration: in units/s^2, 0 reaches max_velocity at once
  *
  *  return value: 0 == OK,
  *                error codes and error handling needs to be defined
@@ -131,7 +187,7 @@ int moveHome(int axis_no,
  *
  *  direction:    either <0 or >=0
  *  max_velocity: >0 velocity after acceleration has been done
- *  acceleration: time in seconds to reach max_velocity
+ *  acceleration: in units/s^2, 0 reaches max_velocity at once
  *
  *  return value: 0 == OK,
  *                error codes and error handling needs to be defined
@@ -147,7 +203,7 @@ int moveAbsolute(int axis_no,
  *
  *  direction:    either <0 or >=0
  *  max_velocity: >0 velocity after acceleration has been done
- *  acceleration: time in seconds to reach max_velocity
+ *  acceleration: in units/s^2, 0 reaches max_velocity at once
  *
  *  return value: 0 == OK,
  *                error codes and error handling needs to be defined
@@ -165,7 +221,7 @@ int moveRelative(int axis_no,
  *  axis_no       1..max
  *  direction:    either <0 or >=0
  *  max_velocity: >0 velocity after acceleration has been done
- *  acceleration: time in seconds to reach max_velocity
+ *  acceleration: in units/s^2, 0 reaches max_velocity at once
  *
  *  return value: 0 == OK,
  *                error codes and error handling needs to be defined
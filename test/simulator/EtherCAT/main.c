@@ -14,6 +14,7 @@
 
 #include "sock-util.h"
 #include "logerr_info.h"
+#include "cmd_Sim.h"
 
 /* defines */
 /*****************************************************************************/
@@ -34,13 +35,32 @@ void help_and_exit(const char *msg)
   }
 
   fprintf(stderr,
-          "Usage    telnet_motor\n"
+          "Usage    telnet_motor [-v flags] [-o bytes] [-O drop|close] [-t threads] [-T hz] [-c clock] [-a axes] [-p port]...\n"
           "Example: telnet_motor -v \n"
           "Example: telnet_motor -v   1 prints all data received\n"
           "Example: telnet_motor -v   2 prints all data send\n"
           "Example: telnet_motor -v   3 prints all data received or send\n"
           "Example: telnet_motor -v  64 prints the socket events\n"
           "Example: telnet_motor -v 128 prints all data received or send\n"
+          "Example: telnet_motor -o 65536 max bytes queued for a slow client\n"
+          "Example: telnet_motor -O drop  drop responses above -o (default close)\n"
+          "Example: telnet_motor -t 4     4 worker threads (default one per CPU)\n"
+          "Example: telnet_motor -t 0     no worker threads\n"
+          "Example: telnet_motor -T 1000  move the axes 1000 times a second\n"
+          "                               (default: when they are polled)\n"
+          "Example: telnet_motor -c 20    the simulated time runs 20 times faster\n"
+          "Example: telnet_motor -c step  the time moves with Sim.advance=<ms>\n"
+          "                               (default: -c real)\n"
+          "Example: telnet_motor -a 4000  simulate 4000 axes (default 8)\n"
+          "Example: telnet_motor -p 5000  listen on port 5000 (the default)\n"
+          "Example: telnet_motor -p 5000,EAT,1-4 -p 5001,IcePAP,5-8\n"
+          "Example: telnet_motor -p 5000 -p 48898,ADS   binary ADS (AMS/TCP)\n"
+          "Example: telnet_motor -p unix:/tmp/simMotor -p unix:@simMotor\n"
+          "         port[,personality[,first_axis-last_axis]]\n"
+          "         port may be a unix socket, @ is the abstract namespace\n"
+          "         personality is auto, EAT, IcePAP, TCPsim or ADS\n"
+          "         auto: the first valid line decides, per connection\n"
+          "         axis 1 of the port is first_axis of the simulator\n"
           "Example:\n");
 
   exit(1);
@@ -51,25 +71,91 @@ void help_and_exit(const char *msg)
 /*****************************************************************************/
 int main(int argc, char** argv)
 {
+  size_t out_hwm = 0;
+  int out_hwm_disconnect = 1;
+  int num_workers = -1;
+  int tick_hz = 0;
+  const char *sim_clock = NULL;
+  int num_axes = NUM_AXES_DEFAULT;
+  int opt;
+
 #if (!defined _WIN32 && !defined __WIN32__ && !defined __CYGWIN__)
   (void)signal(SIGPIPE, SIG_IGN);
 #endif
 
-  if (argc == 3 &&
-      !strcmp(argv[1], "-v")) {
-    debug_print_flags = atoi(argv[2]);
-    if (!debug_print_flags) {
-      help_and_exit("debug_print_flags must not be 0");
+  while ((opt = getopt(argc, argv, "v:o:O:t:T:c:a:p:")) != -1) {
+    switch (opt) {
+      case 'v':
+        debug_print_flags = atoi(optarg);
+        if (!debug_print_flags) {
+          help_and_exit("debug_print_flags must not be 0");
+        }
+        break;
+      case 'o':
+        out_hwm = (size_t)strtoul(optarg, NULL, 0);
+        if (!out_hwm) {
+          help_and_exit("bytes must not be 0");
+        }
+        break;
+      case 'O':
+        if (!strcmp(optarg, "drop")) {
+          out_hwm_disconnect = 0;
+        } else if (!strcmp(optarg, "close")) {
+          out_hwm_disconnect = 1;
+        } else {
+          help_and_exit("-O must be drop or close");
+        }
+        break;
+      case 't':
+        num_workers = atoi(optarg);
+        if (num_workers < 0) {
+          help_and_exit("threads must not be negative");
+        }
+        break;
+      case 'T':
+        tick_hz = atoi(optarg);
+        if (tick_hz < 0 || tick_hz > 10000) {
+          help_and_exit("the tick rate must be 0..10000 Hz");
+        }
+        break;
+      case 'c':
+        sim_clock = optarg;
+        break;
+      case 'a':
+        num_axes = atoi(optarg);
+        if (num_axes < 1 || num_axes > NUM_AXES_MAX) {
+          help_and_exit("the number of axes is out of range");
+        }
+        break;
+      case 'p':
+        if (socket_add_listener(optarg)) {
+          help_and_exit("invalid -p");
+        }
+        break;
+      default:
+        help_and_exit(NULL);
     }
-  } else if (argc == 1) {
-    ;
-  } else {
+  }
+  if (optind != argc) {
     fprintf(stderr, "argc=%d\n", argc);
 
     help_and_exit("wrong argc");
   }
 
   stdlog = stdout;
+  socket_set_output_hwm(out_hwm, out_hwm_disconnect);
+  if (num_workers >= 0) {
+    socket_set_num_workers(num_workers);
+  }
+  socket_set_tick_hz((unsigned)tick_hz);
+  if (cmd_set_num_axes(num_axes)) {
+    LOGERR("%s/%s:%d can not allocate %d axes\n",
+           __FILE__, __FUNCTION__, __LINE__, num_axes);
+    exit(2);
+  }
+  if (sim_clock && cmd_Sim_set_clock(sim_clock)) {
+    help_and_exit("the clock must be real, step or a factor");
+  }
   socket_loop();
 
   LOGINFO("End %s\n", __FUNCTION__);
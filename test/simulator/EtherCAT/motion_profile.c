@@ -0,0 +1,212 @@
+#include <string.h>
+#include <math.h>
+
+#include "motion_profile.h"
+
+/* Iterations of the bisection of the peak velocity of a short move */
+#define PEAK_VELOCITY_ITERATIONS 60
+
+/*****************************************************************************/
+/*
+ * The durations of a ramp from 0 to velocity (or back):
+ * tj with a constant jerk at the start and at the end,
+ * ta with a constant acceleration in between.
+ * acceleration <= 0 means a jump of the velocity
+ */
+static void ramp_times(double velocity, double acceleration, double jerk,
+                       double *tj, double *ta)
+{
+  *tj = 0;
+  *ta = 0;
+  if (acceleration <= 0 || velocity <= 0) {
+    return;
+  }
+  if (jerk <= 0) {
+    *ta = velocity / acceleration;
+  } else if (velocity * jerk >= acceleration * acceleration) {
+    *tj = acceleration / jerk;
+    *ta = velocity / acceleration - *tj;
+  } else {
+    /* The acceleration is not reached */
+    *tj = sqrt(velocity / jerk);
+  }
+}
+
+/* The distance of a ramp, which is symmetric around its middle */
+static double ramp_distance(double velocity, double acceleration, double jerk)
+{
+  double tj;
+  double ta;
+  ramp_times(velocity, acceleration, jerk, &tj, &ta);
+  return velocity * (2 * tj + ta) / 2;
+}
+
+/*****************************************************************************/
+/*
+ * Append a segment, which starts at the current end of the profile
+ * and lasts duration seconds.  The state at its end follows in
+ * closed form.  An endless segment is not followed by another one
+ */
+static void add_segment(motion_profile_type *profile, double duration,
+                        double accel, double jerk)
+{
+  int n = profile->num_segments;
+  double t = profile->end_time;
+  double p = profile->end_pos;
+  double v = profile->end_vel;
+
+  if (duration <= 0 && !profile->endless) {
+    return;
+  }
+  profile->t[n] = t;
+  profile->p[n] = p;
+  profile->v[n] = v;
+  profile->a[n] = accel;
+  profile->j[n] = jerk;
+  profile->num_segments = n + 1;
+  if (profile->endless) {
+    return;
+  }
+  profile->end_time = t + duration;
+  profile->end_pos = p + v * duration + accel * duration * duration / 2 +
+    jerk * duration * duration * duration / 6;
+  profile->end_vel = v + accel * duration + jerk * duration * duration / 2;
+}
+
+/* The velocity after the last segment: where a ramp ends, or a jump */
+static void set_end_velocity(motion_profile_type *profile, double velocity)
+{
+  profile->end_vel = velocity;
+}
+
+/* Add the segments of a ramp from 0 up to velocity */
+static void add_ramp_up(motion_profile_type *profile, double velocity,
+                        double acceleration, double jerk)
+{
+  double tj;
+  double ta;
+  ramp_times(velocity, acceleration, jerk, &tj, &ta);
+  add_segment(profile, tj, 0, jerk);
+  add_segment(profile, ta, tj ? jerk * tj : acceleration, 0);
+  add_segment(profile, tj, jerk * tj, -jerk);
+  set_end_velocity(profile, velocity);
+}
+
+/* Add the segments of a ramp from velocity down to 0 */
+static void add_ramp_down(motion_profile_type *profile, double velocity,
+                          double deceleration, double jerk)
+{
+  double tj;
+  double ta;
+  ramp_times(velocity, deceleration, jerk, &tj, &ta);
+  add_segment(profile, tj, 0, -jerk);
+  add_segment(profile, ta, tj ? -jerk * tj : -deceleration, 0);
+  add_segment(profile, tj, -jerk * tj, jerk);
+  set_end_velocity(profile, 0);
+}
+
+/*****************************************************************************/
+void motion_profile_move(motion_profile_type *profile,
+                         double distance, double max_velocity,
+                         double acceleration, double deceleration,
+                         double jerk)
+{
+  double velocity = fabs(max_velocity);
+  double ramps;
+
+  memset(profile, 0, sizeof(*profile));
+  profile->sign = distance < 0 ? -1.0 : 1.0;
+  distance = fabs(distance);
+  if (!distance || !velocity) {
+    return;
+  }
+  ramps = ramp_distance(velocity, acceleration, jerk) +
+    ramp_distance(velocity, deceleration, jerk);
+  if (ramps > distance) {
+    /* A short move: find the peak velocity, where the ramps meet */
+    double low = 0;
+    double high = velocity;
+    int i;
+    for (i = 0; i < PEAK_VELOCITY_ITERATIONS; i++) {
+      double mid = (low + high) / 2;
+      if (ramp_distance(mid, acceleration, jerk) +
+          ramp_distance(mid, deceleration, jerk) > distance) {
+        high = mid;
+      } else {
+        low = mid;
+      }
+    }
+    velocity = low;
+    ramps = ramp_distance(velocity, acceleration, jerk) +
+      ramp_distance(velocity, deceleration, jerk);
+  }
+  add_ramp_up(profile, velocity, acceleration, jerk);
+  if (distance > ramps) {
+    add_segment(profile, (distance - ramps) / velocity, 0, 0);
+  }
+  add_ramp_down(profile, velocity, deceleration, jerk);
+  /* Rounding must not leave the axis short of its target */
+  profile->end_pos = distance;
+}
+
+void motion_profile_jog(motion_profile_type *profile, double velocity,
+                        double acceleration, double jerk)
+{
+  memset(profile, 0, sizeof(*profile));
+  profile->sign = velocity < 0 ? -1.0 : 1.0;
+  add_ramp_up(profile, fabs(velocity), acceleration, jerk);
+  profile->endless = 1;
+  add_segment(profile, 0, 0, 0);
+}
+
+/*****************************************************************************/
+/* The segment which is active at time t, -1 before the first one */
+static int find_segment(const motion_profile_type *profile, double t)
+{
+  int n = profile->num_segments - 1;
+  while (n >= 0 && profile->t[n] > t) {
+    n--;
+  }
+  return n;
+}
+
+double motion_profile_pos(const motion_profile_type *profile, double t)
+{
+  int n;
+  double dt;
+  if (t <= 0) {
+    return 0;
+  }
+  if (!profile->endless && t >= profile->end_time) {
+    return profile->sign * profile->end_pos;
+  }
+  n = find_segment(profile, t);
+  if (n < 0) {
+    return 0;
+  }
+  dt = t - profile->t[n];
+  return profile->sign *
+    (profile->p[n] + profile->v[n] * dt + profile->a[n] * dt * dt / 2 +
+     profile->j[n] * dt * dt * dt / 6);
+}
+
+double motion_profile_vel(const motion_profile_type *profile, double t)
+{
+  int n;
+  double dt;
+  if (t < 0 || (!profile->endless && t >= profile->end_time)) {
+    return 0;
+  }
+  n = find_segment(profile, t);
+  if (n < 0) {
+    return 0;
+  }
+  dt = t - profile->t[n];
+  return profile->sign *
+    (profile->v[n] + profile->a[n] * dt + profile->j[n] * dt * dt / 2);
+}
+
+int motion_profile_done(const motion_profile_type *profile, double t)
+{
+  return !profile->endless && t >= profile->end_time;
+}
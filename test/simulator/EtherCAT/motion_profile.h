@@ -0,0 +1,49 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+/*
+ * The motion profile of a move, computed once when the move starts.
+ * It is made of segments with a constant jerk: a trapezoid has
+ * no jerk (the acceleration jumps), an S-curve limits the jerk.
+ * Position and velocity at a time are evaluated in closed form,
+ * without stepping through the time.
+ * All profiles start at rest, at position 0, at time 0 (seconds).
+ */
+#define MOTION_PROFILE_SEGMENTS_MAX 7
+
+typedef struct motion_profile_type {
+  int    num_segments;
+  int    endless;   /* A jog: the last segment goes on for ever */
+  double sign;      /* The profile is computed for positive moves */
+  double end_time;
+  double end_pos;
+  double end_vel;
+  /* Start time and state at the start of each segment */
+  double t[MOTION_PROFILE_SEGMENTS_MAX];
+  double p[MOTION_PROFILE_SEGMENTS_MAX];
+  double v[MOTION_PROFILE_SEGMENTS_MAX];
+  double a[MOTION_PROFILE_SEGMENTS_MAX];
+  double j[MOTION_PROFILE_SEGMENTS_MAX];
+} motion_profile_type;
+
+/*
+ * A move over distance (may be negative) with up to max_velocity.
+ * acceleration and deceleration are in units/s^2, 0 means that the
+ * velocity changes at once.  jerk is in units/s^3, 0 is a trapezoid
+ */
+void motion_profile_move(motion_profile_type *profile,
+                         double distance, double max_velocity,
+                         double acceleration, double deceleration,
+                         double jerk);
+
+/* Accelerate to velocity (may be negative), and keep it */
+void motion_profile_jog(motion_profile_type *profile, double velocity,
+                        double acceleration, double jerk);
+
+double motion_profile_pos(const motion_profile_type *profile, double t);
+double motion_profile_vel(const motion_profile_type *profile, double t);
+
+/* The move has reached its end (never for a jog) */
+int motion_profile_done(const motion_profile_type *profile, double t);
+
+#endif /* MOTION_PROFILE_H */
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <float.h>
+
+#include "num_codec.h"
+
+/* All integers up to 2^53 are exact in a double */
+#define EXACT_INT_MAX ((uint64_t)1 << 53)
+/* 10^0 .. 10^22 are exact in a double */
+#define EXACT_POW10_MAX 22
+
+static const double pow10_tab[EXACT_POW10_MAX + 1] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+  1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*****************************************************************************/
+/* Write m with frac_digits digits after the '.', return the end */
+static char *format_fixed(char *p, uint64_t m, int frac_digits)
+{
+  char digits[24];
+  int num_digits = 0;
+  int i;
+
+  do {
+    digits[num_digits++] = (char)('0' + m % 10);
+    m /= 10;
+  } while (m);
+  /* Leading zeros: 0.00123 */
+  while (num_digits <= frac_digits) {
+    digits[num_digits++] = '0';
+  }
+  for (i = num_digits - 1; i >= 0; i--) {
+    *p++ = digits[i];
+    if (i == frac_digits && i) {
+      *p++ = '.';
+    }
+  }
+  *p = '\0';
+  return p;
+}
+
+/*
+ * Most values (positions, velocities) have few digits after the '.'.
+ * Find the smallest k for which an integer m with m / 10^k == value
+ * exists.  m and 10^k are exact, and the division is correctly
+ * rounded, so "m * 10^-k" reads back as value: this is the shortest
+ * fixed notation which round trips.
+ * Returns 0 if value is outside the range where this works.
+ */
+static int format_fast(char *p, double value)
+{
+  int k;
+
+  for (k = 0; k <= 17; k++) {
+    double scaled = value * pow10_tab[k];
+    uint64_t m;
+    int d;
+    if (scaled >= (double)EXACT_INT_MAX) {
+      return 0;
+    }
+    m = (uint64_t)(scaled + 0.5);
+    /* scaled may be rounded, try the neighbours as well */
+    for (d = -1; d <= 1; d++) {
+      uint64_t c = m + d;
+      if ((d < 0 && !m) || c > EXACT_INT_MAX) continue;
+      if ((double)c / pow10_tab[k] == value) {
+        format_fixed(p, c, k);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+char *num_format_double(char *buf, double value)
+{
+  char *p = buf;
+  int precision;
+
+  if (value == 0.0 || value != value || value - value != 0.0) {
+    /* 0, -0, nan, inf */
+    snprintf(buf, NUM_DOUBLE_BUFLEN, "%g", value);
+    return buf;
+  }
+  if (value < 0) {
+    *p++ = '-';
+    if (format_fast(p, -value)) {
+      return buf;
+    }
+  } else if (format_fast(p, value)) {
+    return buf;
+  }
+  /* Very large or small, or many digits: 17 digits are always enough.
+     %g drops trailing zeros, so only subnormals, which have less
+     precision, may need fewer than 15 digits */
+  precision = (value > -DBL_MIN && value < DBL_MIN) ? 1 : 15;
+  for (; precision < 17; precision++) {
+    snprintf(buf, NUM_DOUBLE_BUFLEN, "%.*g", precision, value);
+    if (strtod(buf, NULL) == value) {
+      return buf;
+    }
+  }
+  snprintf(buf, NUM_DOUBLE_BUFLEN, "%.17g", value);
+  return buf;
+}
+
+/*****************************************************************************/
+/*
+ * Up to 19 significant digits and an exponent are collected.
+ * If the digits fit into 2^53 and |exponent| <= 22, both are exact
+ * doubles, and one multiplication or division gives the correctly
+ * rounded result (Clinger's fast path).  Otherwise strtod() does it.
+ */
+int num_parse_double(const char *str, double *value)
+{
+  const char *p = str;
+  uint64_t m = 0;
+  int num_digits = 0;
+  int dropped_digits = 0;
+  int exp10 = 0;
+  int negative = 0;
+  int any_digit = 0;
+
+  while (isspace((unsigned char)*p)) p++;
+  if (*p == '-' || *p == '+') {
+    negative = *p == '-';
+    p++;
+  }
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    goto slow;
+  }
+  while (*p >= '0' && *p <= '9') {
+    any_digit = 1;
+    if (num_digits < 19) {
+      if (m || *p != '0') {
+        m = m * 10 + (uint64_t)(*p - '0');
+        num_digits++;
+      }
+    } else {
+      dropped_digits++;
+    }
+    p++;
+  }
+  exp10 = dropped_digits;
+  if (*p == '.') {
+    p++;
+    while (*p >= '0' && *p <= '9') {
+      any_digit = 1;
+      if (num_digits < 19) {
+        if (m || *p != '0') {
+          m = m * 10 + (uint64_t)(*p - '0');
+          num_digits++;
+        }
+        exp10--;
+      } else {
+        dropped_digits++;
+      }
+      p++;
+    }
+  }
+  if (!any_digit) {
+    /* inf, nan, hex, or no number at all */
+    goto slow;
+  }
+  if (*p == 'e' || *p == 'E') {
+    const char *e = p + 1;
+    int exp_negative = 0;
+    int exp_val = 0;
+    if (*e == '-' || *e == '+') {
+      exp_negative = *e == '-';
+      e++;
+    }
+    if (*e >= '0' && *e <= '9') {
+      while (*e >= '0' && *e <= '9') {
+        if (exp_val < 10000) {
+          exp_val = exp_val * 10 + (*e - '0');
+        }
+        e++;
+      }
+      exp10 += exp_negative ? -exp_val : exp_val;
+    }
+  }
+  if (dropped_digits || m > EXACT_INT_MAX ||
+      exp10 > EXACT_POW10_MAX || exp10 < -EXACT_POW10_MAX) {
+    goto slow;
+  }
+  {
+    double v = (double)m;
+    if (exp10 >= 0) {
+      v *= pow10_tab[exp10];
+    } else {
+      v /= pow10_tab[-exp10];
+    }
+    *value = negative ? -v : v;
+    return 1;
+  }
+slow:
+  {
+    char *end;
+    double v = strtod(str, &end);
+    if (end == str) {
+      return 0;
+    }
+    *value = v;
+    return 1;
+  }
+}
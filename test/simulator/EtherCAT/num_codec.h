@@ -0,0 +1,23 @@
+#ifndef NUM_CODEC_H
+#define NUM_CODEC_H
+
+/*
+ * Conversion of doubles to and from text for the command handlers.
+ * Formatting gives the shortest text which reads back as the same
+ * double.  Parsing is exact.  Neither depends on the locale.
+ */
+
+/* Enough for "-1.2345678901234567e-308" */
+#define NUM_DOUBLE_BUFLEN 32
+
+/* Format value into buf, which has NUM_DOUBLE_BUFLEN bytes, return buf */
+char *num_format_double(char *buf, double value);
+
+/*
+ * Parse a double like sscanf(str, "%lf", value):
+ * leading white space is skipped, trailing characters are ignored.
+ * Returns 1 if a number was found, 0 otherwise.
+ */
+int num_parse_double(const char *str, double *value);
+
+#endif /* NUM_CODEC_H */
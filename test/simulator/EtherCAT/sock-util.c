@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h> /* strcasecmp */
 #include <stdio.h>
 #include <unistd.h>
 #include <libgen.h>
@@ -7,6 +8,7 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <sys/time.h>
+#include <time.h>        /* clock_gettime */
 
 #include "sock-util.h"
 #if (!defined _WIN32 && !defined __WIN32__ && !defined __CYGWIN__)
@@ -23,6 +25,23 @@
 #include <arpa/inet.h>   /* htons, ntohs .. */
 #include <netdb.h>
 #include <sys/select.h>
+#include <sys/uio.h>     /* writev */
+#include <sys/un.h>      /* sockaddr_un */
+#include <sys/stat.h>
+#include <stddef.h>      /* offsetof */
+#include <fcntl.h>
+#endif
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#endif
+#ifdef USE_IO_URING
+#ifndef USE_EPOLL
+#error "USE_IO_URING needs USE_EPOLL to fall back to"
+#endif
+#include <poll.h>
+#include "uring.h"
 #endif
 
 #ifdef START_WINSOCK2
@@ -33,91 +52,487 @@
 
 
 #include "sock-util.h"
+#include "cmd_buf.h"
+#include "timer_wheel.h"
 #include "logerr_info.h"
 
 /* defines */
-#define NUM_CLIENT_CONS 5
 #define CLIENT_CONS_BUFLEN 1024
+#define CLIENT_CONS_INITIAL 64
+#define LISTEN_BACKLOG SOMAXCONN
+/* "unix:/path" or "unix:@name" (Linux abstract namespace) */
+#define UNIX_PREFIX "unix:"
+#ifdef USE_EPOLL
+#define EPOLL_MAX_EVENTS 256
+#endif
+/* Max number of output blocks written with one writev() */
+#define OUT_IOV_MAX 64
+/* Output is queued in blocks of this size */
+#define OUT_BLOCK_LEN 4096
+/* Unused blocks kept by a reactor for reuse */
+#define OUT_BLOCKS_KEEP 256
+/* Default high-water mark for the output queue of a connection */
+#define OUT_HWM_DEFAULT (1024 * 1024)
+/* Resolution of the timers of a reactor */
+#define TIMER_TICK_MS 10
+/* The longest time to wait for events */
+#define MAX_WAIT_MS (2 * 60 * 60 * 1000) /*  2 hours */
+/* Subscriptions of a connection */
+#define NOTIFY_MAX_PER_CON 64
+#define NOTIFY_NAME_LEN    64
+/* A longer value is not compared, but always pushed */
+#define NOTIFY_VALUE_LEN   256
+#ifdef USE_EPOLL
+/* epoll_event.data.u64 of a listening socket, the index is or'ed in */
+#define EPOLL_LISTEN_TAG ((uint64_t)1 << 32)
+/* epoll_event.data.u64 of the eventfd of a worker */
+#define EPOLL_WAKE_TAG   ((uint64_t)1 << 33)
+/* Accepted sockets on their way to a worker, must be a power of 2 */
+#define HANDOFF_RING_LEN 256
+#define WORKERS_MAX 64
+#endif
+#ifdef USE_IO_URING
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+/* Receive buffers of a reactor, must be a power of 2 */
+#define URING_RECV_BUFS  256
+#define URING_BGID       0
+/* user_data of a completion: a tag, and the fd or the listen index */
+#define URING_LISTEN_TAG ((uint64_t)1 << 32)
+#define URING_WAKE_TAG   ((uint64_t)1 << 33)
+#define URING_RECV_TAG   ((uint64_t)1 << 34)
+#define URING_SEND_TAG   ((uint64_t)1 << 35)
+#define URING_FD_MASK    (((uint64_t)1 << 32) - 1)
+#endif
 
 /*****************************************************************************/
 
 /* typedefs */
+/* A block of output waiting to be sent, filled up to len */
+typedef struct out_chunk_type {
+  struct out_chunk_type *next;
+  size_t        len;
+  size_t        sent;
+  char          data[OUT_BLOCK_LEN];
+} out_chunk_type;
+
+/*
+ * A subscription of a connection: the value of name is pushed
+ * every cycle_ms, or only when it has changed
+ */
+typedef struct notify_type {
+  struct notify_type *next;
+  struct client_con_type *client_con;
+  timer_type    timer;
+  unsigned      cycle_ms;
+  int           on_change;
+  int           sent;       /* last_value is valid */
+  size_t        last_len;
+  char          name[NOTIFY_NAME_LEN];
+  char          last_value[NOTIFY_VALUE_LEN];
+} notify_type;
+
 typedef struct client_con_type {
   size_t        len_used;
+  size_t        buflen;      /* Grows for a long line or frame */
   unsigned char *buffer;
-  time_t        last_active_sec;
+  uint64_t      last_active_ms;
   time_t        idleTimeout;
+  /* Armed while idleTimeout is set.  It is not moved on every
+     receive: when it fires, it checks last_active_ms */
+  timer_type    idle_timer;
   int           fd;
+  int           close_pending;
+  const port_cfg_type *port_cfg;
+  /* Of the port, or found out from the first line */
+  int           personality;
+  /* While corked, responses are queued and sent in one go */
+  int           corked;
+  out_chunk_type *out_head;
+  out_chunk_type *out_tail;
+  size_t        out_queued;
+  unsigned      out_dropped;
+  int           out_more;    /* More parts of the response follow */
+  int           out_drop_response; /* Drop the rest of the response */
+  /* The response to the line which is handled */
+  cmd_buf_type  cmd_buf;
+  notify_type   *notifies;
+  int           num_notifies;
+#ifdef USE_IO_URING
+  /* Operations the kernel works on, the connection can not be
+     freed before the last one has completed */
+  int           uring_inflight;
+  int           recv_armed;
+  int           send_inflight;
+  int           shut_down;
+  struct msghdr send_msg;
+  struct iovec  send_iov[OUT_IOV_MAX];
+#endif
 } client_con_type;
 
+typedef struct listen_con_type {
+  port_cfg_type port_cfg;
+  const char    *transport; /* "tcp" or "unix" */
+  int           fd;
+} listen_con_type;
+
+#ifdef USE_EPOLL
+/* An accepted socket, handed from the main thread to a worker */
+typedef struct handoff_type {
+  int           fd;
+  const port_cfg_type *port_cfg;
+} handoff_type;
+#endif
+
+/*
+ * A reactor waits for the events of its connections and handles them.
+ * Every worker thread has its own reactor, a connection belongs to
+ * exactly one of them, so the connections need no locking.
+ * The main thread accepts new connections and hands them over.
+ */
+typedef struct reactor_type {
+  /* The table is indexed by the file descriptor, and grows on demand */
+  client_con_type **client_cons;
+  int           num_client_cons;
+  int           max_client_fd;
+  int           idx;
+  /* Sent blocks, to be reused for output */
+  out_chunk_type *free_out_chunks;
+  int           num_free_out_chunks;
+  timer_wheel_type timers;
+#ifdef USE_EPOLL
+  int           epoll_fd;
+  int           wake_fd;
+  pthread_t     thread;
+  /* Lock free ring: written by the main thread, read by the worker */
+  unsigned      handoff_head;
+  unsigned      handoff_tail;
+  handoff_type  handoff_ring[HANDOFF_RING_LEN];
+#endif
+#ifdef USE_IO_URING
+  uring_type    uring;
+  uring_buf_ring_type recv_bufs;
+#endif
+} reactor_type;
+
+/* forward declarations */
+static void flush_client_con(client_con_type *client_con);
+static void idle_timer_expired(void *data, uint64_t now_ms);
+static void notify_timer_expired(void *data, uint64_t now_ms);
+#ifdef USE_IO_URING
+static int uring_arm_recv(reactor_type *reactor, client_con_type *client_con);
+static void uring_send(client_con_type *client_con);
+#endif
+
 /* static variables */
-static client_con_type client_cons[NUM_CLIENT_CONS];
+static reactor_type main_reactor;
+/* The reactor of the calling thread */
+static __thread reactor_type *cur_reactor;
+static listen_con_type *listen_cons;
+static int num_listen_cons;
+#ifdef USE_EPOLL
+/* -1 means one per CPU */
+static int num_workers = -1;
+static reactor_type *workers;
+static unsigned next_worker;
+/* 0: the axes move when they are polled */
+static unsigned tick_hz;
+#endif
+#ifdef USE_IO_URING
+/* Cleared when the kernel can not do what we need */
+static int use_uring = 1;
+#endif
+static size_t out_hwm = OUT_HWM_DEFAULT;
+static int out_hwm_disconnect = 1;
 /*****************************************************************************/
-void init_client_cons(void)
+static out_chunk_type *get_out_chunk(void)
 {
-  unsigned i;
-  memset(client_cons, 0, sizeof(client_cons));
-  for (i=0; i < NUM_CLIENT_CONS; i++) {
-    client_cons[i].fd = -1; /* fd is closed */
-    client_cons[i].buffer = malloc(CLIENT_CONS_BUFLEN);
+  reactor_type *reactor = cur_reactor;
+  out_chunk_type *out_chunk = reactor->free_out_chunks;
+  if (out_chunk) {
+    reactor->free_out_chunks = out_chunk->next;
+    reactor->num_free_out_chunks--;
+  } else {
+    out_chunk = malloc(sizeof(*out_chunk));
+    if (!out_chunk) {
+      return NULL;
+    }
   }
+  out_chunk->next = NULL;
+  out_chunk->len = 0;
+  out_chunk->sent = 0;
+  return out_chunk;
 }
 
-void add_client_con(int fd)
+static void put_out_chunk(out_chunk_type *out_chunk)
 {
-  unsigned int i;
-  for (i=0; i < NUM_CLIENT_CONS; i++) {
-    if (client_cons[i].fd < 0) {
-      client_cons[i].fd = fd;
-      client_cons[i].idleTimeout = 0;
-      LOGINFO7("%s/%s:%d add i=%d fd=%d\n",
-               __FILE__,__FUNCTION__, __LINE__, i, fd);
-      return;
+  reactor_type *reactor = cur_reactor;
+  if (reactor->num_free_out_chunks >= OUT_BLOCKS_KEEP) {
+    free(out_chunk);
+    return;
+  }
+  out_chunk->next = reactor->free_out_chunks;
+  reactor->free_out_chunks = out_chunk;
+  reactor->num_free_out_chunks++;
+}
+
+/* Remove len sent bytes from the output queue */
+static void out_queue_sent(client_con_type *client_con, size_t len)
+{
+  client_con->out_queued -= len;
+  while (len > 0) {
+    out_chunk_type *out_chunk = client_con->out_head;
+    size_t chunk_len = out_chunk->len - out_chunk->sent;
+    if (len < chunk_len) {
+      out_chunk->sent += len;
+      break;
     }
+    len -= chunk_len;
+    client_con->out_head = out_chunk->next;
+    put_out_chunk(out_chunk);
   }
-  LOGINFO7("%s/%s:%d add() and close() i=%d fd=%d\n",
-           __FILE__,__FUNCTION__, __LINE__, i, fd);
-  /* No more space, we should close the oldest not used,
-       the most stale.
-       But now we close the new one */
-  close(fd);
+  if (!client_con->out_head) {
+    client_con->out_tail = NULL;
+  }
+}
+
+static client_con_type *find_client_con(int fd)
+{
+  reactor_type *reactor = cur_reactor;
+  if (reactor && fd >= 0 && fd < reactor->num_client_cons) {
+    return reactor->client_cons[fd];
+  }
+  return NULL;
 }
 
+static int set_nonblocking(int fd)
+{
+#ifdef USE_WINSOCK2
+  u_long on = 1;
+  return ioctlsocket(fd, FIONBIO, &on) ? -1 : 0;
+#else
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0) return -1;
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static int grow_client_cons(reactor_type *reactor, int fd)
+{
+  client_con_type **new_client_cons;
+  int num_client_cons = reactor->num_client_cons;
+  int new_num = num_client_cons ? num_client_cons : CLIENT_CONS_INITIAL;
+  while (new_num <= fd) {
+    new_num *= 2;
+  }
+  new_client_cons = realloc(reactor->client_cons,
+                            new_num * sizeof(*new_client_cons));
+  if (!new_client_cons) {
+    return -1;
+  }
+  memset(&new_client_cons[num_client_cons], 0,
+         (new_num - num_client_cons) * sizeof(*new_client_cons));
+  LOGINFO7("%s/%s:%d reactor=%d num_client_cons=%d new_num=%d\n",
+           __FILE__,__FUNCTION__, __LINE__, reactor->idx,
+           num_client_cons, new_num);
+  reactor->client_cons = new_client_cons;
+  reactor->num_client_cons = new_num;
+  return 0;
+}
 
-int find_client_con(int fd)
+static void add_client_con(int fd, const port_cfg_type *port_cfg)
 {
-  unsigned int i;
-  for (i=0; i < NUM_CLIENT_CONS; i++) {
-    if (client_cons[i].fd == fd) {
-      LOGINFO7("%s/%s:%d add i=%d fd=%d\n",
-               __FILE__,__FUNCTION__, __LINE__, i, fd);
-      return i;
+  reactor_type *reactor = cur_reactor;
+  client_con_type *client_con;
+#ifdef USE_EPOLL
+  struct epoll_event ev;
+#else
+  if (fd >= FD_SETSIZE) {
+    LOGERR("%s/%s:%d fd=%d >= FD_SETSIZE, calling close()\n",
+           __FILE__,__FUNCTION__, __LINE__, fd);
+    close(fd);
+    return;
+  }
+#endif
+  if (fd >= reactor->num_client_cons && grow_client_cons(reactor, fd)) {
+    LOGERR_ERRNO("no memory for fd=%d, calling close()\n", fd);
+    close(fd);
+    return;
+  }
+  client_con = calloc(1, sizeof(*client_con));
+  if (client_con) {
+    client_con->buffer = malloc(CLIENT_CONS_BUFLEN);
+    client_con->buflen = CLIENT_CONS_BUFLEN;
+  }
+  if (!client_con || !client_con->buffer) {
+    LOGERR_ERRNO("no memory for fd=%d, calling close()\n", fd);
+    if (client_con) free(client_con);
+    close(fd);
+    return;
+  }
+  client_con->fd = fd;
+  client_con->port_cfg = port_cfg;
+  client_con->personality = port_cfg ? port_cfg->personality : PERSONALITY_AUTO;
+  timer_init(&client_con->idle_timer, idle_timer_expired, client_con);
+#ifdef USE_IO_URING
+  if (use_uring) {
+    /* The socket stays blocking, io_uring waits for it */
+    if (uring_arm_recv(reactor, client_con)) {
+      LOGERR("%s/%s:%d fd=%d no SQE, calling close()\n",
+             __FILE__,__FUNCTION__, __LINE__, fd);
+      free(client_con->buffer);
+      free(client_con);
+      close(fd);
+      return;
+    }
+  } else
+#endif
+  {
+    if (set_nonblocking(fd)) {
+      LOGERR_ERRNO("set_nonblocking() fd=%d failed\n", fd);
+    }
+#ifdef USE_EPOLL
+    memset(&ev, 0, sizeof(ev));
+    /* Edge triggered: EPOLLOUT only fires when the socket
+       becomes writable again */
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = (uint64_t)fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+      LOGERR_ERRNO("epoll_ctl(ADD) fd=%d failed, calling close()\n", fd);
+      free(client_con->buffer);
+      free(client_con);
+      close(fd);
+      return;
     }
+#endif
   }
-  return -1;
+  reactor->client_cons[fd] = client_con;
+  if (fd > reactor->max_client_fd) {
+    reactor->max_client_fd = fd;
+  }
+  LOGINFO7("%s/%s:%d reactor=%d add fd=%d\n",
+           __FILE__,__FUNCTION__, __LINE__, reactor->idx, fd);
 }
 
-void close_and_remove_client_con_i(int i)
+static void close_and_remove_client_con(client_con_type *client_con)
 {
-  if (i >= 0) {
-    int fd = client_cons[i].fd;
-    int res = close(fd);
-    LOGINFO7("%s/%s:%d close i=%d fd=%d res=%d (%s)\n",
-             __FILE__,__FUNCTION__, __LINE__,
-             i, fd, res,
-             res ? strerror(errno) : "");
-    client_cons[i].fd = -1;
+  reactor_type *reactor = cur_reactor;
+  int fd = client_con->fd;
+  int res;
+#ifdef USE_IO_URING
+  if (client_con->uring_inflight) {
+    /* The kernel still uses the connection.  shutdown() ends its
+       operations, the last completion closes it */
+    client_con->close_pending = 1;
+    if (!client_con->shut_down) {
+      client_con->shut_down = 1;
+      (void)shutdown(fd, SHUT_RDWR);
+    }
     return;
   }
-  LOGINFO7("%s/%s:%d close i=%d\n",
-           __FILE__,__FUNCTION__, __LINE__, i);
+#endif
+#ifdef USE_EPOLL
+  if (reactor->epoll_fd >= 0) {
+    (void)epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  }
+#endif
+  res = close(fd);
+  LOGINFO7("%s/%s:%d close fd=%d res=%d (%s)\n",
+           __FILE__,__FUNCTION__, __LINE__,
+           fd, res,
+           res ? strerror(errno) : "");
+  timer_wheel_del(&reactor->timers, &client_con->idle_timer);
+  while (client_con->notifies) {
+    notify_type *notify = client_con->notifies;
+    client_con->notifies = notify->next;
+    timer_wheel_del(&reactor->timers, &notify->timer);
+    free(notify);
+  }
+  reactor->client_cons[fd] = NULL;
+  while (reactor->max_client_fd >= 0 &&
+         !reactor->client_cons[reactor->max_client_fd]) {
+    reactor->max_client_fd--;
+  }
+  while (client_con->out_head) {
+    out_chunk_type *out_chunk = client_con->out_head;
+    client_con->out_head = out_chunk->next;
+    put_out_chunk(out_chunk);
+  }
+  cmd_buf_free(&client_con->cmd_buf);
+  free(client_con->buffer);
+  free(client_con);
 }
 
+/*
+ * Called from inside the command handlers (e.g. when a send() fails):
+ * the connection is still in use by the caller, so only mark it.
+ * The event loop closes it when the handling of the event is done.
+ */
+static void close_and_remove_client_con_fd(int fd)
+{
+  client_con_type *client_con = find_client_con(fd);
+  if (client_con) {
+    client_con->close_pending = 1;
+    return;
+  }
+  LOGINFO7("%s/%s:%d close fd=%d (not found)\n",
+           __FILE__,__FUNCTION__, __LINE__, fd);
+}
 
-void close_and_remove_client_con_fd(int fd)
+/*****************************************************************************/
+#ifndef USE_WINSOCK2
+/*
+ * Unix domain socket for clients on the same host.
+ * A name starting with '@' is in the abstract namespace (Linux),
+ * no file is created for it
+ */
+static int get_unix_listen_socket(const char *path)
 {
-  close_and_remove_client_con_i(find_client_con(fd));
+  struct sockaddr_un addr;
+  socklen_t addrlen;
+  size_t path_len = strlen(path);
+  int sockfd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (!path_len || path_len >= sizeof(addr.sun_path)) {
+    LOGERR("%s/%s:%d invalid path \"%s\"\n",
+           __FILE__, __FUNCTION__, __LINE__, path);
+    return -1;
+  }
+  memcpy(addr.sun_path, path, path_len);
+  addrlen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len);
+  if (path[0] == '@') {
+    addr.sun_path[0] = '\0';
+  } else {
+    struct stat st;
+    /* A socket left over from an earlier run */
+    if (!stat(path, &st) && S_ISSOCK(st.st_mode)) {
+      (void)unlink(path);
+    }
+    addrlen++; /* the '\0' */
+  }
+  sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sockfd < 0) {
+    LOGERR_ERRNO("socket(AF_UNIX) failed\n");
+    return -1;
+  }
+  if (bind(sockfd, (struct sockaddr *)&addr, addrlen) < 0) {
+    LOGERR("%s/%s:%d bind(%s) failed (%s) (errno=%d)\n",
+           __FILE__,__FUNCTION__, __LINE__,
+           path, strerror(errno), errno);
+    close(sockfd);
+    return -1;
+  }
+  if (listen(sockfd, LISTEN_BACKLOG) < 0) {
+    LOGERR("listen() failed\n");
+    close(sockfd);
+    return -1;
+  }
+  LOGINFO("listening on unix socket %s\n", path);
+  return sockfd;
 }
+#endif
 
 /*****************************************************************************/
 
@@ -145,7 +560,14 @@ int get_listen_socket(const char *listen_port_asc)
     LOGERR_ERRNO("startWinSock() failed\n");
     exit(3);
   }
-  init_client_cons();
+  if (!strncmp(listen_port_asc, UNIX_PREFIX, strlen(UNIX_PREFIX))) {
+#ifdef USE_WINSOCK2
+    LOGERR("unix sockets are not supported: %s\n", listen_port_asc);
+    return -1;
+#else
+    return get_unix_listen_socket(listen_port_asc + strlen(UNIX_PREFIX));
+#endif
+  }
 
 #ifndef USE_WINSOCK2
   /* initialize the hints */
@@ -237,7 +659,7 @@ int get_listen_socket(const char *listen_port_asc)
       break;
   }
 
-  if ((sockfd >= 0) && (listen(sockfd, 1) < 0))
+  if ((sockfd >= 0) && (listen(sockfd, LISTEN_BACKLOG) < 0))
   {
     LOGERR("listen() failed\n");
     goto error;
@@ -259,218 +681,1359 @@ int get_listen_socket(const char *listen_port_asc)
   return sockfd;
 }
 
-static void handle_data_on_socket(int i, int fd)
+/*
+ * Keep the data from rest on, which is not handled yet.
+ * It is moved to the start of the buffer, and completed by the next recv().
+ * The buffer grows to hold a whole frame, as told by its header,
+ * or doubles for a line, up to INPUT_LINE_MAX
+ */
+static void keep_rest_of_buffer(client_con_type *client_con, char *rest)
+{
+  char *end = (char *)client_con->buffer + client_con->len_used;
+  size_t need = 0;
+  client_con->len_used = end - rest;
+  if (client_con->len_used && rest != (char *)client_con->buffer) {
+    memmove(client_con->buffer, rest, client_con->len_used);
+  }
+  if (client_con->personality == PERSONALITY_ADS) {
+    int frame_len = input_frame_len(client_con->buffer,
+                                    client_con->len_used);
+    if (frame_len < 0) {
+      LOGERR("%s/%s:%d fd=%d frame too long, calling close()\n",
+             __FILE__, __FUNCTION__, __LINE__, client_con->fd);
+      client_con->close_pending = 1;
+      return;
+    }
+    need = (size_t)frame_len + 1; /* keep one place for the '\0' */
+  } else if (client_con->len_used >= client_con->buflen - 1) {
+    need = 2 * client_con->buflen;
+    if (need > INPUT_LINE_MAX) {
+      LOGERR("%s/%s:%d fd=%d line too long, calling close()\n",
+             __FILE__, __FUNCTION__, __LINE__, client_con->fd);
+      client_con->close_pending = 1;
+      return;
+    }
+  }
+  if (need > client_con->buflen) {
+    unsigned char *buffer = realloc(client_con->buffer, need);
+    if (!buffer) {
+      LOGERR_ERRNO("no memory for fd=%d, calling close()\n",
+                   client_con->fd);
+      client_con->close_pending = 1;
+      return;
+    }
+    client_con->buffer = buffer;
+    client_con->buflen = need;
+  }
+}
+
+/* Handle all complete frames of a binary protocol in the buffer */
+static void handle_frames_in_buffer(client_con_type *client_con)
+{
+  unsigned char *frame = client_con->buffer;
+  unsigned char *end = frame + client_con->len_used;
+
+  cmd_buf_select(&client_con->cmd_buf);
+  while (!client_con->close_pending && frame < end) {
+    int frame_len = handle_input_frame(client_con->fd, client_con->port_cfg,
+                                       frame, end - frame);
+    if (frame_len < 0) {
+      LOGERR("%s/%s:%d fd=%d invalid frame, calling close()\n",
+             __FILE__, __FUNCTION__, __LINE__, client_con->fd);
+      client_con->close_pending = 1;
+    }
+    if (frame_len <= 0) {
+      break;
+    }
+    frame += frame_len;
+  }
+  cmd_buf_select(NULL);
+  keep_rest_of_buffer(client_con, (char *)frame);
+}
+
+/* Handle all complete lines in the buffer */
+static void handle_lines_in_buffer(client_con_type *client_con)
+{
+  int fd = client_con->fd;
+  char *line = (char *)client_con->buffer;
+  char *end = line + client_con->len_used;
+  char *pNewline;
+
+  if (client_con->personality == PERSONALITY_ADS) {
+    handle_frames_in_buffer(client_con);
+    return;
+  }
+  cmd_buf_select(&client_con->cmd_buf);
+  while (!client_con->close_pending &&
+         (pNewline = memchr(line, '\n', end - line))) {
+    char *next_line = pNewline + 1;
+    int had_cr = 0;
+    LOGINFO7("%s/%s:%d fd=%d line_len=%lu\n",
+             __FILE__, __FUNCTION__, __LINE__, fd,
+             (unsigned long)(next_line - line));
+    *pNewline = 0; /* Remove '\n' */
+    if (pNewline > line && pNewline[-1] == '\r') {
+      had_cr = 1;
+      pNewline[-1] = '\0';
+    }
+    if (handle_input_line(fd, client_con->port_cfg,
+                          &client_con->personality,
+                          line, had_cr, 1)) {
+      client_con->close_pending = 1;
+    }
+    line = next_line;
+  }
+  cmd_buf_select(NULL);
+  keep_rest_of_buffer(client_con, line);
+}
+
+/*
+ * len bytes have been appended to the buffer, handle all complete lines
+ */
+static void handle_received_data(client_con_type *client_con, size_t len)
+{
+  size_t len_used = client_con->len_used + len;
+  client_con->len_used = len_used;
+  client_con->buffer[len_used] = '\0';
+  LOGINFO7("%s/%s:%d fd=%d len_used=%lu\n",
+           __FILE__, __FUNCTION__, __LINE__, client_con->fd,
+           (unsigned long)len_used);
+  /* All responses to this chunk of data are sent at once */
+  client_con->corked = 1;
+  handle_lines_in_buffer(client_con);
+  client_con->corked = 0;
+  flush_client_con(client_con);
+}
+
+/*
+ * Read from the socket and handle all complete lines.
+ * Returns the result of recv(), the connection may be closed
+ * when returning <= 0 (or when close_pending is set)
+ */
+static ssize_t handle_data_on_socket(client_con_type *client_con)
 {
   ssize_t read_res = 0;
-  size_t len_used = client_cons[i].len_used;
+  int fd = client_con->fd;
+  size_t len_used = client_con->len_used;
+  int recv_flags = 0;
+#ifdef USE_EPOLL
+  /* Edge triggered: the caller reads until EAGAIN */
+  recv_flags = MSG_DONTWAIT;
+#endif
 
   /* append received data to the end
-     keep one place for the '\n'  */
+     keep one place for the '\0'  */
 
-  read_res = recv(fd, (char *)&client_cons[i].buffer[len_used],
-                  CLIENT_CONS_BUFLEN - len_used - 1, 0);
-  LOGINFO7("%s/%s:%d FD_ISSET fd=%d read_res=%ld\n",
+  read_res = recv(fd, (char *)&client_con->buffer[len_used],
+                  client_con->buflen - len_used - 1, recv_flags);
+  LOGINFO7("%s/%s:%d fd=%d read_res=%ld\n",
            __FILE__, __FUNCTION__, __LINE__, fd, (long)read_res);
   if (read_res <= 0)  {
     if (read_res == 0) {
-      close_and_remove_client_con_i(i);
-      LOGINFO(" EOF i=%d fd=%d\n", i, fd);
+      LOGINFO(" EOF fd=%d\n", fd);
+      client_con->close_pending = 1;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      LOGINFO(" recv() failed fd=%d (%s)\n", fd, strerror(errno));
+      client_con->close_pending = 1;
     }
   } else {
-    char *pNewline;
-    len_used = client_cons[i].len_used + read_res;
-    client_cons[i].len_used = len_used;
-    client_cons[i].buffer[len_used] = '\0';
-    pNewline = strchr((char *)client_cons[i].buffer, '\n');
-    LOGINFO7("%s/%s:%d FD_ISSET i=%d fd=%d len_used=%lu pNewline=%d\n",
-             __FILE__, __FUNCTION__, __LINE__, i, fd,
-             (unsigned long)len_used, pNewline ? 1 : 0);
-    if (pNewline) {
-      size_t line_len = 1 + (void*)pNewline - (void*)client_cons[i].buffer;
-      int had_cr = 0;
-      LOGINFO7("%s/%s:%d FD_ISSET i=%d fd=%d line_len=%lu\n",
-               __FILE__, __FUNCTION__, __LINE__, i, fd,
-               (unsigned long)line_len);
-      *pNewline = 0; /* Remove '\n' */
-      if (line_len > 1) pNewline--;
-      if (*pNewline == '\r') {
-        had_cr = 1;
-        *pNewline = '\0';
+    handle_received_data(client_con, (size_t)read_res);
+  }
+  return read_res;
+}
+
+/*****************************************************************************/
+#ifdef USE_EPOLL
+/*
+ * Hand an accepted socket over to the next worker.
+ * Only the main thread writes handoff_head, only the worker
+ * writes handoff_tail, so no lock is needed
+ */
+static void hand_off_client_con(int fd, const port_cfg_type *port_cfg)
+{
+  int tries;
+  for (tries = 0; tries < num_workers; tries++) {
+    reactor_type *worker = &workers[next_worker++ % num_workers];
+    unsigned head = worker->handoff_head;
+    unsigned tail = __atomic_load_n(&worker->handoff_tail, __ATOMIC_ACQUIRE);
+    if (head - tail < HANDOFF_RING_LEN) {
+      uint64_t one = 1;
+      handoff_type *handoff = &worker->handoff_ring[head % HANDOFF_RING_LEN];
+      handoff->fd = fd;
+      handoff->port_cfg = port_cfg;
+      __atomic_store_n(&worker->handoff_head, head + 1, __ATOMIC_RELEASE);
+      if (write(worker->wake_fd, &one, sizeof(one)) != sizeof(one)) {
+        LOGERR_ERRNO("write() wake_fd worker=%d failed\n", worker->idx);
       }
-      if (handle_input_line(fd, (const char *)&client_cons[i].buffer[0], had_cr, 1)) {
-        close_and_remove_client_con_i(i);
+      LOGINFO7("%s/%s:%d fd=%d worker=%d\n",
+               __FILE__, __FUNCTION__, __LINE__, fd, worker->idx);
+      return;
+    }
+  }
+  LOGERR("%s/%s:%d fd=%d all workers busy, calling close()\n",
+         __FILE__, __FUNCTION__, __LINE__, fd);
+  close(fd);
+}
+
+/*****************************************************************************/
+/* Called in the worker, when the main thread has handed over sockets */
+static void take_handed_off_client_cons(reactor_type *reactor)
+{
+  unsigned tail = reactor->handoff_tail;
+  unsigned head;
+  uint64_t cnt;
+  /* Reset the eventfd first: a socket handed over after
+     reading the head wakes us up again */
+  if (read(reactor->wake_fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) {
+    LOGERR_ERRNO("read() wake_fd worker=%d failed\n", reactor->idx);
+  }
+  head = __atomic_load_n(&reactor->handoff_head, __ATOMIC_ACQUIRE);
+  while (tail != head) {
+    handoff_type *handoff = &reactor->handoff_ring[tail % HANDOFF_RING_LEN];
+    add_client_con(handoff->fd, handoff->port_cfg);
+    tail++;
+  }
+  __atomic_store_n(&reactor->handoff_tail, tail, __ATOMIC_RELEASE);
+}
+#endif
+
+/*****************************************************************************/
+static void handle_accepted_socket(listen_con_type *listen_con,
+                                   int accepted_socket)
+{
+  LOGINFO("Connection accepted fd=%d port=%s transport=%s\n",
+          accepted_socket,
+          listen_con->port_cfg.listen_port_asc,
+          listen_con->transport);
+#ifdef USE_EPOLL
+  if (num_workers) {
+    hand_off_client_con(accepted_socket, &listen_con->port_cfg);
+    return;
+  }
+#endif
+  add_client_con(accepted_socket, &listen_con->port_cfg);
+}
+
+static void handle_listen_socket(listen_con_type *listen_con)
+{
+  /* accept all pending connections */
+  while (1) {
+    int accepted_socket = accept(listen_con->fd, NULL, NULL);
+    if (accepted_socket < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        LOGERR_ERRNO("accept() failed\n");
       }
-      client_cons[i].len_used = 0;
+      return;
     }
+    handle_accepted_socket(listen_con, accepted_socket);
+#ifndef USE_EPOLL
+    /* level triggered: select() tells us if there are more */
+    return;
+#endif
   }
 }
 
 /*****************************************************************************/
-void handle_accepted_socket(int listen_socket, int accepted_socket)
+static void handle_client_con_event(client_con_type *client_con,
+                                    int readable, int writable,
+                                    uint64_t now_ms)
 {
-  /* We come here if we have accepted a new connection */
-  unsigned int i;
-  int end_recv_loop = 0;
-  int end_select_loop = 0;
+  if (writable) {
+    flush_client_con(client_con);
+  }
+  if (readable) {
+    client_con->last_active_ms = now_ms;
+#ifdef USE_EPOLL
+    while (!client_con->close_pending &&
+           handle_data_on_socket(client_con) > 0) {
+      ;
+    }
+#else
+    (void)handle_data_on_socket(client_con);
+#endif
+  }
+  if (client_con->close_pending) {
+    close_and_remove_client_con(client_con);
+    LOGINFO("Connection closed\n");
+  }
+}
+
+/*****************************************************************************/
+static uint64_t get_now_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if (!clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+  }
+#endif
+  {
+    struct timeval tv;
+    (void)gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+  }
+}
+
+/*
+ * Close the connection if it has been idle longer than its timeout.
+ * Otherwise it was active since the timer was armed, wait again
+ */
+static void idle_timer_expired(void *data, uint64_t now_ms)
+{
+  client_con_type *client_con = data;
+  uint64_t deadline_ms = client_con->last_active_ms +
+    (uint64_t)client_con->idleTimeout * 1000;
+
+  if (now_ms > deadline_ms) {
+    LOGINFO7("%s/%s:%d timeout fd=%d\n",
+             __FILE__, __FUNCTION__, __LINE__, client_con->fd);
+    close_and_remove_client_con(client_con);
+  } else {
+    timer_wheel_add(&cur_reactor->timers, &client_con->idle_timer,
+                    deadline_ms + 1);
+  }
+}
+
+/*
+ * Format the value of a subscription, and push it if it has changed
+ * or a value is pushed every cycle
+ */
+static void notify_timer_expired(void *data, uint64_t now_ms)
+{
+  notify_type *notify = data;
+  client_con_type *client_con = notify->client_con;
+  const char *value;
+  size_t len;
+
+  if (client_con->close_pending) {
+    return;
+  }
+  timer_wheel_add(&cur_reactor->timers, &notify->timer,
+                  now_ms + notify->cycle_ms);
+  cmd_buf_select(&client_con->cmd_buf);
+  handle_notify(client_con->port_cfg, notify->name);
+  value = get_buf();
+  len = get_buf_len();
+  if (len && (!notify->on_change || !notify->sent ||
+              len != notify->last_len ||
+              memcmp(value, notify->last_value, len))) {
+    notify->sent = len <= NOTIFY_VALUE_LEN;
+    if (notify->sent) {
+      memcpy(notify->last_value, value, len);
+      notify->last_len = len;
+    }
+    send_to_socket(client_con->fd, value, (unsigned)len, 0);
+  }
+  clear_buf();
+  cmd_buf_select(NULL);
+  if (client_con->close_pending) {
+    /* The send failed, notify is freed as well */
+    close_and_remove_client_con(client_con);
+  }
+}
+
+/*
+ * Call the expired timers of the reactor,
+ * return the number of milliseconds until the next one may expire
+ */
+static int run_timers(reactor_type *reactor)
+{
+  uint64_t now_ms = get_now_ms();
+  timer_wheel_run(&reactor->timers, now_ms);
+  return timer_wheel_next_ms(&reactor->timers, now_ms, MAX_WAIT_MS);
+}
+
+/*****************************************************************************/
+#ifdef USE_IO_URING
+/*
+ * The io_uring backend.  Instead of waiting for readiness and calling
+ * recv()/writev(), the reactor keeps operations queued in the kernel:
+ * a multishot accept per listening socket, a multishot recv per
+ * connection, which takes its buffers from a ring of the reactor,
+ * and one sendmsg() per connection with data to send.
+ * All new operations are submitted with one system call per loop.
+ */
+static int uring_arm_recv(reactor_type *reactor, client_con_type *client_con)
+{
+  struct io_uring_sqe *sqe = uring_get_sqe(&reactor->uring);
+  if (!sqe) {
+    return -1;
+  }
+  uring_prep_multishot_recv(sqe, client_con->fd, URING_BGID);
+  sqe->user_data = URING_RECV_TAG | (uint64_t)client_con->fd;
+  client_con->recv_armed = 1;
+  client_con->uring_inflight++;
+  return 0;
+}
+
+static void uring_arm_accept(reactor_type *reactor, int l)
+{
+  struct io_uring_sqe *sqe = uring_get_sqe(&reactor->uring);
+  if (!sqe) {
+    LOGERR("%s/%s:%d listen_socket=%d no SQE\n",
+           __FILE__, __FUNCTION__, __LINE__, listen_cons[l].fd);
+    return;
+  }
+  uring_prep_multishot_accept(sqe, listen_cons[l].fd);
+  sqe->user_data = URING_LISTEN_TAG | (uint64_t)l;
+}
+
+static void uring_arm_wake(reactor_type *reactor)
+{
+  struct io_uring_sqe *sqe = uring_get_sqe(&reactor->uring);
+  if (!sqe) {
+    LOGERR("%s/%s:%d wake_fd=%d no SQE\n",
+           __FILE__, __FUNCTION__, __LINE__, reactor->wake_fd);
+    return;
+  }
+  uring_prep_multishot_poll(sqe, reactor->wake_fd, POLLIN);
+  sqe->user_data = URING_WAKE_TAG;
+}
+
+/*****************************************************************************/
+/* Send the output queue, one sendmsg() at a time per connection */
+static void uring_send(client_con_type *client_con)
+{
+  struct io_uring_sqe *sqe;
+  out_chunk_type *out_chunk;
+  int iovcnt = 0;
+
+  if (client_con->send_inflight || client_con->close_pending ||
+      !client_con->out_head) {
+    return;
+  }
+  for (out_chunk = client_con->out_head;
+       out_chunk && iovcnt < OUT_IOV_MAX;
+       out_chunk = out_chunk->next) {
+    client_con->send_iov[iovcnt].iov_base = &out_chunk->data[out_chunk->sent];
+    client_con->send_iov[iovcnt].iov_len = out_chunk->len - out_chunk->sent;
+    iovcnt++;
+  }
+  memset(&client_con->send_msg, 0, sizeof(client_con->send_msg));
+  client_con->send_msg.msg_iov = client_con->send_iov;
+  client_con->send_msg.msg_iovlen = iovcnt;
+  sqe = uring_get_sqe(&cur_reactor->uring);
+  if (!sqe) {
+    LOGERR("%s/%s:%d fd=%d no SQE, calling close()\n",
+           __FILE__, __FUNCTION__, __LINE__, client_con->fd);
+    client_con->close_pending = 1;
+    return;
+  }
+  uring_prep_sendmsg(sqe, client_con->fd, &client_con->send_msg,
+                     MSG_NOSIGNAL);
+  sqe->user_data = URING_SEND_TAG | (uint64_t)client_con->fd;
+  client_con->send_inflight = 1;
+  client_con->uring_inflight++;
+}
+
+/*****************************************************************************/
+static void uring_handle_recv(reactor_type *reactor,
+                              client_con_type *client_con,
+                              int res, unsigned cqe_flags, uint64_t now_ms)
+{
+  int fd = client_con->fd;
+  if (!(cqe_flags & IORING_CQE_F_MORE)) {
+    client_con->recv_armed = 0;
+    client_con->uring_inflight--;
+  }
+  if (cqe_flags & IORING_CQE_F_BUFFER) {
+    unsigned bid = cqe_flags >> IORING_CQE_BUFFER_SHIFT;
+    const char *data = uring_buf_ring_buf(&reactor->recv_bufs, bid);
+    size_t len = res > 0 ? (size_t)res : 0;
+    client_con->last_active_ms = now_ms;
+    /* The line buffer may have less space than the receive buffer */
+    while (len && !client_con->close_pending) {
+      size_t space = client_con->buflen - 1 - client_con->len_used;
+      size_t copy_len = len < space ? len : space;
+      memcpy(&client_con->buffer[client_con->len_used], data, copy_len);
+      data += copy_len;
+      len -= copy_len;
+      handle_received_data(client_con, copy_len);
+    }
+    uring_buf_ring_put(&reactor->recv_bufs, bid);
+  }
+  LOGINFO7("%s/%s:%d fd=%d res=%d flags=0x%x\n",
+           __FILE__, __FUNCTION__, __LINE__, fd, res, cqe_flags);
+  if (res == 0) {
+    if (!client_con->shut_down) {
+      LOGINFO(" EOF fd=%d\n", fd);
+    }
+    client_con->close_pending = 1;
+  } else if (res < 0 && res != -ENOBUFS) {
+    /* ENOBUFS: all receive buffers in use, arm again */
+    if (!client_con->shut_down) {
+      LOGINFO(" recv() failed fd=%d (%s)\n", fd, strerror(-res));
+    }
+    client_con->close_pending = 1;
+  }
+  if (!client_con->recv_armed && !client_con->close_pending &&
+      uring_arm_recv(reactor, client_con)) {
+    client_con->close_pending = 1;
+  }
+}
+
+/*****************************************************************************/
+static void uring_handle_send(client_con_type *client_con, int res)
+{
+  client_con->send_inflight = 0;
+  client_con->uring_inflight--;
+  LOGINFO7("%s/%s:%d fd=%d queued=%lu res=%d\n",
+           __FILE__, __FUNCTION__, __LINE__, client_con->fd,
+           (unsigned long)client_con->out_queued, res);
+  if (res < 0) {
+    if (!client_con->shut_down) {
+      LOGERR("%s/%s:%d send fd=%d failed (%s), calling close()\n",
+             __FILE__, __FUNCTION__, __LINE__,
+             client_con->fd, strerror(-res));
+    }
+    client_con->close_pending = 1;
+    return;
+  }
+  out_queue_sent(client_con, (size_t)res);
+  uring_send(client_con);
+}
+
+/*****************************************************************************/
+static void uring_handle_cqe(reactor_type *reactor, uint64_t user_data,
+                             int res, unsigned cqe_flags, uint64_t now_ms)
+{
+  int fd = (int)(user_data & URING_FD_MASK);
+  client_con_type *client_con;
+
+  if (user_data & URING_LISTEN_TAG) {
+    listen_con_type *listen_con = &listen_cons[fd];
+    if (res >= 0) {
+      handle_accepted_socket(listen_con, res);
+    } else {
+      LOGERR("%s/%s:%d accept() failed (%s)\n",
+             __FILE__, __FUNCTION__, __LINE__, strerror(-res));
+    }
+    if (!(cqe_flags & IORING_CQE_F_MORE)) {
+      uring_arm_accept(reactor, fd);
+    }
+    return;
+  }
+  if (user_data & URING_WAKE_TAG) {
+    take_handed_off_client_cons(reactor);
+    if (!(cqe_flags & IORING_CQE_F_MORE)) {
+      uring_arm_wake(reactor);
+    }
+    return;
+  }
+  /* The fd is not closed while operations are in flight */
+  client_con = find_client_con(fd);
+  if (!client_con) {
+    LOGERR("%s/%s:%d fd=%d user_data=0x%llx not found\n",
+           __FILE__, __FUNCTION__, __LINE__, fd,
+           (unsigned long long)user_data);
+    if (cqe_flags & IORING_CQE_F_BUFFER) {
+      uring_buf_ring_put(&reactor->recv_bufs,
+                         cqe_flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+    return;
+  }
+  if (user_data & URING_RECV_TAG) {
+    uring_handle_recv(reactor, client_con, res, cqe_flags, now_ms);
+  } else {
+    uring_handle_send(client_con, res);
+  }
+  if (client_con->close_pending) {
+    close_and_remove_client_con(client_con);
+    if (!find_client_con(fd)) {
+      LOGINFO("Connection closed\n");
+    }
+  }
+}
 
-  add_client_con(accepted_socket);
+/*****************************************************************************/
+static void uring_event_loop(reactor_type *reactor)
+{
+  int end_loop = 0;
   do
   {
-    do
-    {
-      int max_timeout = 2 * 60 * 60; /*  2 hours */
-      int res;
-      fd_set rfds;
-      struct timeval tv_now;
-      struct timeval tv_select;
-      int maxfd = 0;
-
-      (void)gettimeofday(&tv_now, NULL);
-
-      FD_ZERO (&rfds);
-      tv_select.tv_sec = max_timeout;
-      tv_select.tv_usec = 0;
-
-      FD_SET(listen_socket, &rfds);
-      for (i=0; i < NUM_CLIENT_CONS; i++) {
-        int fd = client_cons[i].fd;
-        time_t idleTimeout = client_cons[i].idleTimeout;
-        if (fd < 0) continue;
-        if (idleTimeout) {
-          time_t last_active_sec = client_cons[i].last_active_sec;
-          if (tv_now.tv_sec - idleTimeout > last_active_sec) {
-            LOGINFO7("%s/%s:%d timeout i=%d fd=%d\n",
-                     __FILE__, __FUNCTION__, __LINE__, i, fd);
-            close_and_remove_client_con_i(i);
-            fd = -1;
-          } else {
-            /* Wait at least 1 second */
-            time_t wait_now = 1 + idleTimeout + last_active_sec - tv_now.tv_sec;
-            if (tv_select.tv_sec > wait_now) {
-              tv_select.tv_sec = wait_now;
-            }
+    int timeout_ms;
+    struct io_uring_cqe *cqe;
+    uint64_t now_ms;
+    int res;
+
+    timeout_ms = run_timers(reactor);
+    LOGINFO7("%s/%s:%d io_uring_enter(): reactor=%d timeout_ms=%d\n",
+             __FILE__, __FUNCTION__, __LINE__, reactor->idx, timeout_ms);
+    res = uring_submit_and_wait(&reactor->uring, timeout_ms);
+    if (res && res != -ETIME && res != -EINTR) {
+      LOGERR("%s/%s:%d io_uring_enter() failed (%s)\n",
+             __FILE__, __FUNCTION__, __LINE__, strerror(-res));
+      end_loop = 1;
+      continue;
+    }
+    now_ms = get_now_ms();
+    while ((cqe = uring_peek_cqe(&reactor->uring))) {
+      uint64_t user_data = cqe->user_data;
+      int cqe_res = cqe->res;
+      unsigned cqe_flags = cqe->flags;
+      uring_cqe_seen(&reactor->uring);
+      uring_handle_cqe(reactor, user_data, cqe_res, cqe_flags, now_ms);
+    }
+  } while (!end_loop);
+  LOGINFO("End of loop reactor=%d\n", reactor->idx);
+}
+
+/*****************************************************************************/
+/*
+ * Set up the ring of a reactor.
+ * The first one checks that the kernel can do a multishot recv
+ * from a buffer ring, which needs Linux 6.0
+ */
+static int uring_reactor_init(reactor_type *reactor, int check)
+{
+  int res = uring_init(&reactor->uring, URING_SQ_ENTRIES, URING_CQ_ENTRIES);
+  int sv[2];
+  if (res) {
+    return res;
+  }
+  res = uring_buf_ring_init(&reactor->uring, &reactor->recv_bufs,
+                            URING_RECV_BUFS, CLIENT_CONS_BUFLEN, URING_BGID);
+  if (res || !check) {
+    goto done;
+  }
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+    res = -errno;
+    goto done;
+  }
+  res = -EOPNOTSUPP;
+  {
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->uring);
+    uring_prep_multishot_recv(sqe, sv[0], URING_BGID);
+    if (write(sv[1], "x", 1) == 1) {
+      /* The data, and after close() the EOF */
+      int more = 1;
+      close(sv[1]);
+      while (more && !uring_submit_and_wait(&reactor->uring, 1000)) {
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&reactor->uring))) {
+          if (cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE)) {
+            res = 0;
           }
-        }
-        if (fd >= 0) {
-          FD_SET(fd, &rfds);
-          if (maxfd < fd) {
-            maxfd = fd;
+          if (cqe->flags & IORING_CQE_F_BUFFER) {
+            uring_buf_ring_put(&reactor->recv_bufs,
+                               cqe->flags >> IORING_CQE_BUFFER_SHIFT);
           }
+          more = cqe->flags & IORING_CQE_F_MORE;
+          uring_cqe_seen(&reactor->uring);
         }
       }
-      maxfd = listen_socket > maxfd ? listen_socket : maxfd;
-      LOGINFO7("%s/%s:%d select(): maxfd=%d tv_sec=%lu\n",
-               __FILE__, __FUNCTION__, __LINE__,
-               maxfd, (unsigned long)tv_select.tv_sec);
-      res = select (maxfd + 1, &rfds, NULL, NULL, &tv_select);
-      LOGINFO7("%s/%s:%d maxfd=%d res(select)=%d %s\n",
-               __FILE__, __FUNCTION__, __LINE__,
-               maxfd,
-               res,
-               res < 0 ? strerror(errno) : "");
-      (void)gettimeofday(&tv_now, NULL);
-      if (res < 0) {
+    } else {
+      close(sv[1]);
+    }
+  }
+  close(sv[0]);
+
+  done:
+  if (res) {
+    uring_exit(&reactor->uring);
+  }
+  return res;
+}
+#endif
+
+/*****************************************************************************/
+static void event_loop(reactor_type *reactor)
+{
+  int end_select_loop = 0;
+  int l;
+#ifdef USE_EPOLL
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+#endif
+
+  cur_reactor = reactor;
+#ifdef USE_IO_URING
+  if (use_uring) {
+    uring_event_loop(reactor);
+    return;
+  }
+#endif
+  do
+  {
+    int timeout_ms;
+    int res;
+    uint64_t now_ms;
+#ifdef USE_EPOLL
+    int i;
+#else
+    fd_set rfds;
+    fd_set wfds;
+    struct timeval tv_select;
+    int maxfd = 0;
+    int fd;
+#endif
+
+    timeout_ms = run_timers(reactor);
+
+#ifdef USE_EPOLL
+    LOGINFO7("%s/%s:%d epoll_wait(): reactor=%d timeout_ms=%d\n",
+             __FILE__, __FUNCTION__, __LINE__, reactor->idx, timeout_ms);
+    res = epoll_wait(reactor->epoll_fd, events, EPOLL_MAX_EVENTS,
+                     timeout_ms);
+#else
+    FD_ZERO (&rfds);
+    FD_ZERO (&wfds);
+    tv_select.tv_sec = timeout_ms / 1000;
+    tv_select.tv_usec = (timeout_ms % 1000) * 1000;
+
+    for (l = 0; l < num_listen_cons; l++) {
+      FD_SET(listen_cons[l].fd, &rfds);
+      if (maxfd < listen_cons[l].fd) {
+        maxfd = listen_cons[l].fd;
+      }
+    }
+    for (fd = 0; fd <= reactor->max_client_fd; fd++) {
+      if (!reactor->client_cons[fd]) continue;
+      FD_SET(fd, &rfds);
+      if (reactor->client_cons[fd]->out_head) {
+        FD_SET(fd, &wfds);
+      }
+      if (maxfd < fd) {
+        maxfd = fd;
+      }
+    }
+    LOGINFO7("%s/%s:%d select(): maxfd=%d tv_sec=%lu\n",
+             __FILE__, __FUNCTION__, __LINE__,
+             maxfd, (unsigned long)tv_select.tv_sec);
+    res = select (maxfd + 1, &rfds, &wfds, NULL, &tv_select);
+#endif
+    LOGINFO7("%s/%s:%d res=%d %s\n",
+             __FILE__, __FUNCTION__, __LINE__,
+             res,
+             res < 0 ? strerror(errno) : "");
+    now_ms = get_now_ms();
+    if (res < 0) {
+      if (errno != EINTR) {
         end_select_loop = 1;
-        end_recv_loop = 1;
-      } else {
-        if (FD_ISSET (listen_socket, &rfds)) {
-          LOGINFO7("%s/%s:%d FD_ISSET (listen_socket)\n",
-                   __FILE__, __FUNCTION__, __LINE__);
-          end_recv_loop = 1;
-        } else {
-          unsigned int i;
-
-          for (i=0; i < NUM_CLIENT_CONS; i++) {
-            int fd = client_cons[i].fd;
-            if (fd < 0) continue;
-            if (FD_ISSET (fd, &rfds)) {
-              LOGINFO7("%s/%s:%d FD_ISSET fd=%d\n",
-                       __FILE__, __FUNCTION__, __LINE__, fd);
-              client_cons[i].last_active_sec = tv_now.tv_sec;
-              handle_data_on_socket(i, fd);
-            } else {
-            }
-          }
-        }
       }
-    } while (!end_recv_loop && !end_select_loop);
-  } while (!end_recv_loop);
-  LOGINFO("End of loop\n");
+      continue;
+    }
+#ifdef USE_EPOLL
+    for (i = 0; i < res; i++) {
+      int fd;
+      client_con_type *client_con;
+      if (events[i].data.u64 & EPOLL_LISTEN_TAG) {
+        l = (int)(events[i].data.u64 & ~EPOLL_LISTEN_TAG);
+        handle_listen_socket(&listen_cons[l]);
+        continue;
+      }
+      if (events[i].data.u64 & EPOLL_WAKE_TAG) {
+        take_handed_off_client_cons(reactor);
+        continue;
+      }
+      fd = (int)events[i].data.u64;
+      /* The connection may have been closed by an earlier event */
+      client_con = find_client_con(fd);
+      if (!client_con) continue;
+      LOGINFO7("%s/%s:%d fd=%d events=0x%x\n",
+               __FILE__, __FUNCTION__, __LINE__, fd,
+               (unsigned)events[i].events);
+      handle_client_con_event(client_con,
+                              events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR),
+                              events[i].events & EPOLLOUT,
+                              now_ms);
+    }
+#else
+    for (l = 0; l < num_listen_cons; l++) {
+      if (FD_ISSET (listen_cons[l].fd, &rfds)) {
+        LOGINFO7("%s/%s:%d FD_ISSET (listen_socket=%d)\n",
+                 __FILE__, __FUNCTION__, __LINE__, listen_cons[l].fd);
+        handle_listen_socket(&listen_cons[l]);
+      }
+    }
+    for (fd = 0; fd <= maxfd && fd <= reactor->max_client_fd; fd++) {
+      client_con_type *client_con = reactor->client_cons[fd];
+      if (!client_con) continue;
+      if (FD_ISSET (fd, &rfds) || FD_ISSET (fd, &wfds)) {
+        LOGINFO7("%s/%s:%d FD_ISSET fd=%d\n",
+                 __FILE__, __FUNCTION__, __LINE__, fd);
+        handle_client_con_event(client_con,
+                                FD_ISSET (fd, &rfds),
+                                FD_ISSET (fd, &wfds),
+                                now_ms);
+      }
+    }
+#endif
+  } while (!end_select_loop);
+  LOGINFO("End of loop reactor=%d\n", reactor->idx);
+}
+
+/*****************************************************************************/
+static void reactor_init(reactor_type *reactor, int idx)
+{
+  memset(reactor, 0, sizeof(*reactor));
+  reactor->idx = idx;
+  reactor->max_client_fd = -1;
+  timer_wheel_init(&reactor->timers, TIMER_TICK_MS, get_now_ms());
+#ifdef USE_EPOLL
+  reactor->wake_fd = -1;
+  reactor->epoll_fd = -1;
+#endif
+#ifdef USE_IO_URING
+  if (use_uring) {
+    int res = uring_reactor_init(reactor, !idx);
+    if (!res) {
+      return;
+    }
+    if (idx) {
+      LOGERR("%s/%s:%d io_uring failed (%s)\n",
+             __FILE__, __FUNCTION__, __LINE__, strerror(-res));
+      exit(3);
+    }
+    LOGINFO("io_uring not usable (%s), using epoll\n", strerror(-res));
+    use_uring = 0;
+  }
+#endif
+#ifdef USE_EPOLL
+  reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (reactor->epoll_fd < 0) {
+    LOGERR_ERRNO("epoll_create1() failed\n");
+    exit(3);
+  }
+#endif
+}
+
+/*****************************************************************************/
+#ifdef USE_EPOLL
+static void *worker_thread(void *arg)
+{
+  event_loop((reactor_type *)arg);
+  return NULL;
 }
 
 /*****************************************************************************/
-void send_to_socket(int fd, const char *buf, unsigned len)
+static void start_workers(void)
+{
+  int w;
+  if (num_workers < 0) {
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = num_cpus > 0 ? (int)num_cpus : 1;
+  }
+  if (num_workers > WORKERS_MAX) {
+    num_workers = WORKERS_MAX;
+  }
+  if (!num_workers) {
+    return;
+  }
+  workers = calloc(num_workers, sizeof(*workers));
+  if (!workers) {
+    LOGERR_ERRNO("no memory for %d workers\n", num_workers);
+    exit(3);
+  }
+  for (w = 0; w < num_workers; w++) {
+    reactor_type *worker = &workers[w];
+    struct epoll_event ev;
+    int res;
+    reactor_init(worker, w + 1);
+    worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (worker->wake_fd < 0) {
+      LOGERR_ERRNO("eventfd() failed\n");
+      exit(3);
+    }
+#ifdef USE_IO_URING
+    if (use_uring) {
+      uring_arm_wake(worker);
+    } else
+#endif
+    {
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.u64 = EPOLL_WAKE_TAG;
+      if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &ev)) {
+        LOGERR_ERRNO("epoll_ctl(ADD) wake_fd=%d failed\n", worker->wake_fd);
+        exit(3);
+      }
+    }
+    res = pthread_create(&worker->thread, NULL, worker_thread, worker);
+    if (res) {
+      errno = res;
+      LOGERR_ERRNO("pthread_create() failed\n");
+      exit(3);
+    }
+  }
+  LOGINFO("started %d worker threads\n", num_workers);
+}
+#endif
+/*****************************************************************************/
+#ifdef USE_EPOLL
+/*
+ * Move the axes at a fixed rate, independent of the polling.
+ * The next tick is due at an absolute time, so that the rate
+ * does not drift with the time spent in the tick
+ */
+static void *tick_thread(void *arg)
 {
+  long period_ns = 1000000000L / (long)tick_hz;
+  struct timespec next;
+  (void)arg;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &next);
+  while (1) {
+    next.tv_nsec += period_ns;
+    while (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+      ;
+    }
+    /* The axes are locked one by one, not with the command handlers */
+    handle_tick();
+  }
+  return NULL;
+}
+
+static void start_tick_thread(void)
+{
+  pthread_t thread;
   int res;
-  errno = 0;
-  res = send(fd, buf, len, 0);
-#ifdef ENOTSOCK
-  if (res == -1 && errno == ENOTSOCK) {
+  if (!tick_hz) {
+    return;
+  }
+  res = pthread_create(&thread, NULL, tick_thread, NULL);
+  if (res) {
+    errno = res;
+    LOGERR_ERRNO("pthread_create() failed\n");
+    exit(3);
+  }
+  (void)pthread_detach(thread);
+  LOGINFO("tick thread at %u Hz\n", tick_hz);
+}
+#endif
+/*****************************************************************************/
+/*
+ * Write as much of the output queue as the socket takes without blocking.
+ * Many queued responses are written with one writev()
+ */
+static void flush_client_con(client_con_type *client_con)
+{
+  int fd = client_con->fd;
+#ifdef USE_IO_URING
+  if (use_uring) {
+    uring_send(client_con);
+    return;
+  }
+#endif
+  while (client_con->out_head && !client_con->close_pending) {
+    out_chunk_type *out_chunk;
+    ssize_t res;
+#ifdef USE_WINSOCK2
+    out_chunk = client_con->out_head;
+    res = send(fd, &out_chunk->data[out_chunk->sent],
+               out_chunk->len - out_chunk->sent, 0);
 #else
-  if (res == -1) {
+    struct iovec iov[OUT_IOV_MAX];
+    int iovcnt = 0;
+    for (out_chunk = client_con->out_head;
+         out_chunk && iovcnt < OUT_IOV_MAX;
+         out_chunk = out_chunk->next) {
+      iov[iovcnt].iov_base = &out_chunk->data[out_chunk->sent];
+      iov[iovcnt].iov_len = out_chunk->len - out_chunk->sent;
+      iovcnt++;
+    }
+    res = writev(fd, iov, iovcnt);
 #endif
-    res = write(fd, buf, len);
-    if (res != (int)len)
-    {
-      LOGERR_ERRNO("write(%u %d) failed, calling close()\n",
-                   len, res);
+    LOGINFO7("%s/%s:%d fd=%d queued=%lu res=%ld\n",
+             __FILE__, __FUNCTION__, __LINE__, fd,
+             (unsigned long)client_con->out_queued, (long)res);
+    if (res < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        /* Wait until the socket is writable */
+        return;
+      }
+      if (errno == EINTR) continue;
+      LOGERR_ERRNO("send fd=%d failed, calling close()\n", fd);
       close_and_remove_client_con_fd(fd);
+      return;
     }
+    out_queue_sent(client_con, (size_t)res);
   }
-  else if (res != (int)len)
-  {
-    LOGERR_ERRNO("send(%u %d) failed, calling close()\n",
-                 len, res);
-    close_and_remove_client_con_fd(fd);
+}
+
+/*****************************************************************************/
+/* Write to a file descriptor which is not a connection, e.g. stdout */
+static void write_crlf(int fd, const char *buf, unsigned len, int add_cr)
+{
+  while (len) {
+    const char *pNewline = add_cr ? memchr(buf, '\n', len) : NULL;
+    unsigned part_len = pNewline ? (unsigned)(pNewline - buf) : len;
+    if (write(fd, buf, part_len) != (ssize_t)part_len) {
+      LOGERR_ERRNO("write(%u) failed\n", part_len);
+      return;
+    }
+    buf += part_len;
+    len -= part_len;
+    if (pNewline) {
+      if ((!part_len || pNewline[-1] != '\r') && write(fd, "\r", 1) != 1) {
+        LOGERR_ERRNO("write(1) failed\n");
+        return;
+      }
+      if (write(fd, "\n", 1) != 1) {
+        LOGERR_ERRNO("write(1) failed\n");
+        return;
+      }
+      buf++;
+      len--;
+    }
   }
 }
 
+/*****************************************************************************/
+/*
+ * Queue the output, and send it unless the connection is corked.
+ * The data is copied into the blocks of the output queue;
+ * with add_cr each "\n" becomes "\r\n" while copying.
+ * more: the response is not complete, more parts follow.
+ * The HWM is checked at the first part, the parts of a response
+ * are queued or dropped as a whole.  It limits what is queued already:
+ * a response to an empty queue is queued, however long it is
+ */
+static void queue_to_socket(int fd, const char *buf, unsigned len,
+                            int add_cr, int more)
+{
+  client_con_type *client_con = find_client_con(fd);
+  char oldc = 0;
+  if (!client_con) {
+    write_crlf(fd, buf, len, add_cr);
+    return;
+  }
+  if (client_con->close_pending) {
+    return;
+  }
+  if (!client_con->out_more && len) {
+    /* The start of a response */
+    client_con->out_drop_response = client_con->out_queued &&
+      client_con->out_queued + len > out_hwm;
+    if (client_con->out_drop_response) {
+      /* A slow consumer, which does not read its responses.
+         Log only the first of the dropped responses */
+      if (out_hwm_disconnect || !client_con->out_dropped) {
+        LOGERR("%s/%s:%d fd=%d queued=%lu len=%u hwm=%lu %s\n",
+               __FILE__, __FUNCTION__, __LINE__, fd,
+               (unsigned long)client_con->out_queued, len,
+               (unsigned long)out_hwm,
+               out_hwm_disconnect ? "calling close()" : "dropped");
+      }
+      client_con->out_dropped++;
+      if (out_hwm_disconnect) {
+        close_and_remove_client_con_fd(fd);
+        return;
+      }
+    } else if (client_con->out_dropped) {
+      LOGERR("%s/%s:%d fd=%d dropped=%u\n",
+             __FILE__, __FUNCTION__, __LINE__, fd,
+             client_con->out_dropped);
+      client_con->out_dropped = 0;
+    }
+  }
+  client_con->out_more = more;
+  if (client_con->out_drop_response || !len) {
+    return;
+  }
+  while (len) {
+    out_chunk_type *out_chunk = client_con->out_tail;
+    char *dst;
+    size_t space;
+    size_t copy_len = 0;
+    if (!out_chunk || out_chunk->len == OUT_BLOCK_LEN) {
+      out_chunk = get_out_chunk();
+      if (!out_chunk) {
+        LOGERR_ERRNO("no memory fd=%d, calling close()\n", fd);
+        close_and_remove_client_con_fd(fd);
+        return;
+      }
+      if (client_con->out_tail) {
+        client_con->out_tail->next = out_chunk;
+      } else {
+        client_con->out_head = out_chunk;
+      }
+      client_con->out_tail = out_chunk;
+    }
+    dst = &out_chunk->data[out_chunk->len];
+    space = OUT_BLOCK_LEN - out_chunk->len;
+    if (!add_cr) {
+      copy_len = len < space ? len : space;
+      memcpy(dst, buf, copy_len);
+      buf += copy_len;
+      len -= copy_len;
+    } else {
+      while (len && copy_len < space) {
+        char c = *buf;
+        if (c == '\n' && oldc != '\r') {
+          /* The '\n' follows, may be in the next block */
+          c = '\r';
+        } else {
+          buf++;
+          len--;
+        }
+        dst[copy_len++] = c;
+        oldc = c;
+      }
+    }
+    out_chunk->len += copy_len;
+    client_con->out_queued += copy_len;
+  }
+  if (!client_con->corked) {
+    flush_client_con(client_con);
+  }
+}
+
+void send_to_socket(int fd, const char *buf, unsigned len, int add_cr)
+{
+  queue_to_socket(fd, buf, len, add_cr, 0);
+}
+
+void send_part_to_socket(int fd, const char *buf, unsigned len, int add_cr)
+{
+  queue_to_socket(fd, buf, len, add_cr, 1);
+}
+
+/*****************************************************************************/
+/* hwm == 0 keeps the default */
+void socket_set_output_hwm(size_t hwm, int disconnect)
+{
+  if (hwm) {
+    out_hwm = hwm;
+  }
+  out_hwm_disconnect = disconnect;
+}
+
+
+/*****************************************************************************/
+static int parse_personality(const char *name)
+{
+  if (!strcasecmp(name, "auto"))   return PERSONALITY_AUTO;
+  if (!strcasecmp(name, "EAT"))    return PERSONALITY_EAT;
+  if (!strcasecmp(name, "IcePAP")) return PERSONALITY_ICEPAP;
+  if (!strcasecmp(name, "TCPsim")) return PERSONALITY_TCPSIM;
+  if (!strcasecmp(name, "ADS"))    return PERSONALITY_ADS;
+  return -1;
+}
+
+/*****************************************************************************/
+/*
+ * port[,personality[,first_axis[-last_axis]]]
+ * e.g. "5000", "5001,IcePAP", "5002,EAT,3-4"
+ * port may be a unix socket: "unix:/tmp/simMotor", "unix:@simMotor"
+ * Returns 0 if OK
+ */
+int socket_add_listener(const char *port_spec)
+{
+  listen_con_type *new_listen_cons;
+  port_cfg_type port_cfg;
+  char *spec = strdup(port_spec);
+  char *personality_str;
+  char *axes_str = NULL;
+
+  if (!spec) return -1;
+  memset(&port_cfg, 0, sizeof(port_cfg));
+  port_cfg.listen_port_asc = spec;
+  port_cfg.personality = PERSONALITY_AUTO;
+  port_cfg.first_axis = 1;
+  personality_str = strchr(spec, ',');
+  if (personality_str) {
+    *personality_str++ = '\0';
+    axes_str = strchr(personality_str, ',');
+    if (axes_str) {
+      *axes_str++ = '\0';
+    }
+    port_cfg.personality = parse_personality(personality_str);
+    if (port_cfg.personality < 0) {
+      LOGERR("invalid personality: %s\n", personality_str);
+      goto error;
+    }
+  }
+  if (axes_str) {
+    int first_axis = 0;
+    int last_axis = 0;
+    int nvals = sscanf(axes_str, "%d-%d", &first_axis, &last_axis);
+    if (nvals == 1) {
+      last_axis = first_axis;
+    }
+    if (nvals < 1 || first_axis < 1 || last_axis < first_axis) {
+      LOGERR("invalid axes: %s\n", axes_str);
+      goto error;
+    }
+    port_cfg.first_axis = first_axis;
+    port_cfg.num_axes = 1 + last_axis - first_axis;
+  }
+  new_listen_cons = realloc(listen_cons,
+                            (num_listen_cons + 1) * sizeof(*listen_cons));
+  if (!new_listen_cons) goto error;
+  listen_cons = new_listen_cons;
+  listen_cons[num_listen_cons].port_cfg = port_cfg;
+  listen_cons[num_listen_cons].transport =
+    strncmp(spec, UNIX_PREFIX, strlen(UNIX_PREFIX)) ? "tcp" : "unix";
+  listen_cons[num_listen_cons].fd = -1;
+  num_listen_cons++;
+  return 0;
+
+  error:
+  free(spec);
+  return -1;
+}
 
 /*****************************************************************************/
 void socket_loop(void)
 {
   static const char *listen_port_asc = "5000";
-  int listen_socket;
-  int accepted_socket;
-  int stop_and_exit = 0;
+  int l;
 
-  listen_socket = get_listen_socket(listen_port_asc);
-
-  if (listen_socket < 0)
-  {
-    LOGERR_ERRNO("no listening socket!\n");
-    exit(3);
+  if (!num_listen_cons) {
+    (void)socket_add_listener(listen_port_asc);
   }
+  reactor_init(&main_reactor, 0);
+  for (l = 0; l < num_listen_cons; l++) {
+    int listen_socket;
+    listen_socket = get_listen_socket(listen_cons[l].port_cfg.listen_port_asc);
 
-  while (!stop_and_exit)
-  {
-    accepted_socket = accept(listen_socket, NULL, NULL);
-    if (accepted_socket < 0)
+    if (listen_socket < 0)
     {
-      LOGERR("accept() failed\n");
-      stop_and_exit = 1;
-      continue;
+      LOGERR_ERRNO("no listening socket!\n");
+      exit(3);
+    }
+    listen_cons[l].fd = listen_socket;
+#ifdef USE_EPOLL
+    if (set_nonblocking(listen_socket)) {
+      LOGERR_ERRNO("set_nonblocking() failed\n");
+      exit(3);
     }
+#ifdef USE_IO_URING
+    if (use_uring) {
+      uring_arm_accept(&main_reactor, l);
+    } else
+#endif
+    {
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLET;
+      ev.data.u64 = EPOLL_LISTEN_TAG | (uint64_t)l;
+      if (epoll_ctl(main_reactor.epoll_fd, EPOLL_CTL_ADD, listen_socket, &ev)) {
+        LOGERR_ERRNO("epoll_ctl(ADD) listen_socket=%d failed\n",
+                     listen_socket);
+        exit(3);
+      }
+    }
+#endif
+  }
+#ifdef USE_EPOLL
+  start_workers();
+  start_tick_thread();
+#endif
+#ifdef USE_IO_URING
+  if (use_uring) {
+    LOGINFO("using io_uring\n");
+  }
+#endif
+  event_loop(&main_reactor);
+}
 
-    LOGINFO("Connection accepted fd=%d\n", accepted_socket);
-    handle_accepted_socket(listen_socket, accepted_socket);
-    LOGINFO("Connection closed\n");
+/*****************************************************************************/
+/* num < 0 means one worker per CPU, 0 handles all in the main thread */
+void socket_set_num_workers(int num)
+{
+#ifdef USE_EPOLL
+  num_workers = num;
+#else
+  if (num) {
+    LOGINFO("worker threads are not supported, -t ignored\n");
   }
+#endif
 }
 
+/* hz == 0 moves the axes when they are polled */
+void socket_set_tick_hz(unsigned hz)
+{
+#ifdef USE_EPOLL
+  tick_hz = hz;
+#else
+  if (hz) {
+    LOGINFO("the tick thread is not supported, -T ignored\n");
+  }
+#endif
+}
+
+
+/*****************************************************************************/
+/*
+ * Push the value of name to the connection every cycle_ms, or, with
+ * on_change, only when it has changed.  The first value is pushed
+ * right away.  cycle_ms == 0 ends the subscription.
+ * Returns 0 if OK
+ */
+int socket_subscribe(int fd, const char *name, unsigned cycle_ms, int on_change)
+{
+  client_con_type *client_con = find_client_con(fd);
+  size_t name_len = strlen(name);
+  notify_type **p_notify;
+  notify_type *notify;
+
+  if (!client_con || name_len >= NOTIFY_NAME_LEN) {
+    return -1;
+  }
+  for (p_notify = &client_con->notifies; *p_notify;
+       p_notify = &(*p_notify)->next) {
+    if (!strcmp((*p_notify)->name, name)) {
+      break;
+    }
+  }
+  notify = *p_notify;
+  if (!cycle_ms) {
+    if (notify) {
+      *p_notify = notify->next;
+      timer_wheel_del(&cur_reactor->timers, &notify->timer);
+      free(notify);
+      client_con->num_notifies--;
+    }
+    return 0;
+  }
+  if (!notify) {
+    if (client_con->num_notifies >= NOTIFY_MAX_PER_CON) {
+      return -1;
+    }
+    notify = calloc(1, sizeof(*notify));
+    if (!notify) {
+      return -1;
+    }
+    notify->client_con = client_con;
+    memcpy(notify->name, name, name_len + 1);
+    timer_init(&notify->timer, notify_timer_expired, notify);
+    notify->next = client_con->notifies;
+    client_con->notifies = notify;
+    client_con->num_notifies++;
+  }
+  notify->cycle_ms = cycle_ms < TIMER_TICK_MS ? TIMER_TICK_MS : cycle_ms;
+  notify->on_change = on_change;
+  notify->sent = 0;
+  timer_wheel_add(&cur_reactor->timers, &notify->timer, get_now_ms());
+  LOGINFO7("%s/%s:%d fd=%d name=%s cycle_ms=%u on_change=%d\n",
+           __FILE__, __FUNCTION__, __LINE__, fd, name, cycle_ms, on_change);
+  return 0;
+}
 
 /*****************************************************************************/
 extern int socket_set_timeout(int fd, int timeout)
 {
-  int i = find_client_con(fd);
-  if (i >= 0) {
-    time_t old = client_cons[i].idleTimeout;
-    client_cons[i].idleTimeout = timeout;
-    LOGINFO7("%s/%s:%d i=%d fd=%d timeout=%d (old=%lu)\n",
-             __FILE__, __FUNCTION__, __LINE__, i, fd, timeout, (unsigned long)old);
+  client_con_type *client_con = find_client_con(fd);
+  if (client_con) {
+    time_t old = client_con->idleTimeout;
+    client_con->idleTimeout = timeout;
+    if (timeout > 0) {
+      timer_wheel_add(&cur_reactor->timers, &client_con->idle_timer,
+                      client_con->last_active_ms +
+                      (uint64_t)timeout * 1000 + 1);
+    } else {
+      timer_wheel_del(&cur_reactor->timers, &client_con->idle_timer);
+    }
+    LOGINFO7("%s/%s:%d fd=%d timeout=%d (old=%lu)\n",
+             __FILE__, __FUNCTION__, __LINE__, fd, timeout, (unsigned long)old);
     return 0;
   }
-  LOGINFO7("%s/%s:%d i=%d fd=%d timeout=%d\n",
-           __FILE__, __FUNCTION__, __LINE__, i, fd, timeout);
+  LOGINFO7("%s/%s:%d fd=%d timeout=%d\n",
+           __FILE__, __FUNCTION__, __LINE__, fd, timeout);
   return 1;
 }
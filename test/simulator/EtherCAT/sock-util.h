@@ -1,10 +1,46 @@
+#ifndef SOCK_UTIL_H
+#define SOCK_UTIL_H
+
 #include <stdio.h>
 
-extern int handle_input_line(int socket_fd, const char *input_line, int had_cr, int had_lf);
+/* What a listening port speaks, and which axes it serves */
+#define PERSONALITY_AUTO   0
+#define PERSONALITY_EAT    1
+#define PERSONALITY_ICEPAP 2
+#define PERSONALITY_TCPSIM 3
+#define PERSONALITY_ADS    4  /* binary, AMS/TCP */
+
+typedef struct port_cfg_type {
+  const char *listen_port_asc;
+  int        personality;
+  int        first_axis;  /* axis 1 of the client */
+  int        num_axes;    /* 0 means all axes, unmapped */
+} port_cfg_type;
+
+extern int handle_input_line(int socket_fd, const port_cfg_type *port_cfg,
+                             int *personality,
+                             char *input_line, int had_cr, int had_lf);
+extern int handle_input_frame(int socket_fd, const port_cfg_type *port_cfg,
+                              const unsigned char *buf, size_t len);
+/* The length of the frame at the start of buf, from its header:
+   0 if that is not complete, -1 if the frame is too long */
+extern int input_frame_len(const unsigned char *buf, size_t len);
+/* The receive buffer of a connection grows up to this for a line */
+#define INPUT_LINE_MAX (8 * 1024)
+extern void handle_notify(const port_cfg_type *port_cfg, const char *name);
+extern void handle_tick(void);
 extern int get_listen_socket(const char *listen_port_asc);
-extern int handle_input_line(int socket_fd, const char *input_line, int had_cr, int had_lf);
-extern void send_to_socket(int fd, const char *buf, unsigned len);
+extern int socket_add_listener(const char *port_spec);
+extern void send_to_socket(int fd, const char *buf, unsigned len, int add_cr);
+/* A part of a response, the rest follows with send_to_socket() */
+extern void send_part_to_socket(int fd, const char *buf, unsigned len,
+                                int add_cr);
+extern void socket_set_output_hwm(size_t hwm, int disconnect);
+extern void socket_set_num_workers(int num);
+extern void socket_set_tick_hz(unsigned hz);
 extern int socket_set_timeout(int fd, int seconds);
+extern int socket_subscribe(int fd, const char *name,
+                            unsigned cycle_ms, int on_change);
 void socket_loop(void);
 
 
@@ -13,3 +49,5 @@ void socket_loop(void);
 extern void fd_printf_crlf(int fd, int add_cr, const char *format, ...)__attribute__((format (printf, 3, 4)));
 
 extern FILE *stdlog;
+
+#endif /* SOCK_UTIL_H */
@@ -0,0 +1,202 @@
+#include <string.h>
+
+#include "timer_wheel.h"
+
+#define SLOT_MASK ((uint64_t)TIMER_WHEEL_SLOTS - 1)
+/* Timers further away are parked in the top level, and
+   placed again when that slot comes due */
+#define MAX_DELTA \
+  (((uint64_t)1 << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS)) - 1)
+
+/*****************************************************************************/
+void timer_wheel_init(timer_wheel_type *wheel, unsigned tick_ms,
+                      uint64_t now_ms)
+{
+  memset(wheel, 0, sizeof(*wheel));
+  wheel->tick_ms = tick_ms ? tick_ms : 1;
+  wheel->cur = now_ms / wheel->tick_ms;
+}
+
+void timer_init(timer_type *timer,
+                void (*func)(void *data, uint64_t now_ms), void *data)
+{
+  memset(timer, 0, sizeof(*timer));
+  timer->func = func;
+  timer->data = data;
+  timer->level = -1;
+}
+
+int timer_pending(const timer_type *timer)
+{
+  return timer->level >= 0;
+}
+
+/*****************************************************************************/
+/* Put the timer into the slot for its expiry, seen from wheel->cur */
+static void timer_wheel_place(timer_wheel_type *wheel, timer_type *timer)
+{
+  uint64_t expires = timer->expires;
+  uint64_t delta;
+  timer_type **head;
+  int level = 0;
+  int slot;
+
+  if (expires < wheel->cur) {
+    expires = wheel->cur;
+  }
+  delta = expires - wheel->cur;
+  if (delta > MAX_DELTA) {
+    expires = wheel->cur + MAX_DELTA;
+    delta = MAX_DELTA;
+  }
+  while (level < TIMER_WHEEL_LEVELS - 1 &&
+         delta >> ((level + 1) * TIMER_WHEEL_SLOT_BITS)) {
+    level++;
+  }
+  slot = (int)((expires >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK);
+  head = &wheel->slots[level][slot];
+  timer->level = level;
+  timer->slot = slot;
+  timer->prev = NULL;
+  timer->next = *head;
+  if (*head) {
+    (*head)->prev = timer;
+  }
+  *head = timer;
+  wheel->used_slots[level] |= (uint64_t)1 << slot;
+}
+
+/*****************************************************************************/
+void timer_wheel_del(timer_wheel_type *wheel, timer_type *timer)
+{
+  if (!timer_pending(timer)) {
+    return;
+  }
+  if (timer->prev) {
+    timer->prev->next = timer->next;
+  } else {
+    wheel->slots[timer->level][timer->slot] = timer->next;
+    if (!timer->next) {
+      wheel->used_slots[timer->level] &= ~((uint64_t)1 << timer->slot);
+    }
+  }
+  if (timer->next) {
+    timer->next->prev = timer->prev;
+  }
+  timer->next = timer->prev = NULL;
+  timer->level = -1;
+}
+
+void timer_wheel_add(timer_wheel_type *wheel, timer_type *timer,
+                     uint64_t expires_ms)
+{
+  timer_wheel_del(wheel, timer);
+  /* Round up: never call a timer early */
+  timer->expires = (expires_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+  timer_wheel_place(wheel, timer);
+}
+
+/*****************************************************************************/
+/* Move the timers of a slot one level down (or further) */
+static void timer_wheel_cascade(timer_wheel_type *wheel, int level, int slot)
+{
+  while (wheel->slots[level][slot]) {
+    timer_type *timer = wheel->slots[level][slot];
+    timer_wheel_del(wheel, timer);
+    timer_wheel_place(wheel, timer);
+  }
+}
+
+/*****************************************************************************/
+void timer_wheel_run(timer_wheel_type *wheel, uint64_t now_ms)
+{
+  uint64_t target = now_ms / wheel->tick_ms;
+
+  while (wheel->cur <= target) {
+    uint64_t tick = wheel->cur;
+    uint64_t span_end = (tick | SLOT_MASK) + 1;
+    uint64_t stop = target + 1 < span_end ? target + 1 : span_end;
+    uint64_t bits;
+    int slot;
+    int level;
+
+    /* Entering a new span of level 0: the slots above may be due */
+    for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+      if (tick & (((uint64_t)1 << (level * TIMER_WHEEL_SLOT_BITS)) - 1)) {
+        break;
+      }
+      timer_wheel_cascade(wheel, level,
+                          (int)((tick >> (level * TIMER_WHEEL_SLOT_BITS)) &
+                                SLOT_MASK));
+    }
+    /* Skip the empty slots up to stop */
+    bits = wheel->used_slots[0] >> (tick & SLOT_MASK);
+    if (stop - tick < TIMER_WHEEL_SLOTS) {
+      bits &= ((uint64_t)1 << (stop - tick)) - 1;
+    }
+    if (!bits) {
+      wheel->cur = stop;
+      continue;
+    }
+    tick += __builtin_ctzll(bits);
+    slot = (int)(tick & SLOT_MASK);
+    /* A timer added by a callback goes into a later slot */
+    wheel->cur = tick + 1;
+    while (wheel->slots[0][slot]) {
+      timer_type *timer = wheel->slots[0][slot];
+      timer_wheel_del(wheel, timer);
+      timer->func(timer->data, now_ms);
+    }
+  }
+}
+
+/*****************************************************************************/
+int timer_wheel_next_ms(const timer_wheel_type *wheel, uint64_t now_ms,
+                        int max_ms)
+{
+  uint64_t next = 0;
+  int found = 0;
+  int level;
+
+  for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    unsigned shift = level * TIMER_WHEEL_SLOT_BITS;
+    uint64_t used = wheel->used_slots[level];
+    uint64_t idx;
+    uint64_t rot;
+    uint64_t due;
+    if (!used) continue;
+    idx = (wheel->cur >> shift) & SLOT_MASK;
+    /* Slots from idx on, wrapped around */
+    rot = idx ? (used >> idx) | (used << (TIMER_WHEEL_SLOTS - idx)) : used;
+    if (!level) {
+      due = wheel->cur + __builtin_ctzll(rot);
+    } else {
+      /* A slot of a higher level comes due when its span starts.
+         The slot of the current span is due in the next round,
+         unless that span has not been entered yet */
+      uint64_t dist;
+      if (!(wheel->cur & (((uint64_t)1 << shift) - 1))) {
+        dist = __builtin_ctzll(rot);
+      } else if (rot & ~(uint64_t)1) {
+        dist = __builtin_ctzll(rot & ~(uint64_t)1);
+      } else {
+        dist = TIMER_WHEEL_SLOTS;
+      }
+      due = ((wheel->cur >> shift) + dist) << shift;
+    }
+    if (!found || due < next) {
+      next = due;
+      found = 1;
+    }
+  }
+  if (found) {
+    uint64_t due_ms = next * wheel->tick_ms;
+    if (due_ms <= now_ms) {
+      return 0;
+    }
+    if (due_ms - now_ms < (uint64_t)max_ms) {
+      return (int)(due_ms - now_ms);
+    }
+  }
+  return max_ms;
+}
@@ -0,0 +1,53 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+/*
+ * Hierarchical timing wheel.
+ * Adding, removing and expiring a timer is O(1), however many
+ * timers there are.  Level 0 has one slot per tick, each level above
+ * covers 64 times the time of the level below; a timer moves down
+ * when its slot of a higher level comes due.
+ * A wheel is not thread safe, each reactor has its own.
+ */
+#include <stdint.h>
+
+#define TIMER_WHEEL_LEVELS    4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS     (1 << TIMER_WHEEL_SLOT_BITS)
+
+typedef struct timer_type {
+  struct timer_type *next;
+  struct timer_type *prev;
+  uint64_t      expires;    /* in ticks */
+  void          (*func)(void *data, uint64_t now_ms);
+  void          *data;
+  int           level;      /* -1 when not pending */
+  int           slot;
+} timer_type;
+
+typedef struct timer_wheel_type {
+  uint64_t      cur;        /* the next tick to handle */
+  unsigned      tick_ms;
+  uint64_t      used_slots[TIMER_WHEEL_LEVELS]; /* one bit per slot */
+  timer_type    *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_type;
+
+void timer_wheel_init(timer_wheel_type *wheel, unsigned tick_ms,
+                      uint64_t now_ms);
+void timer_init(timer_type *timer,
+                void (*func)(void *data, uint64_t now_ms), void *data);
+
+/* (Re-)arm the timer, it is called at expires_ms or later */
+void timer_wheel_add(timer_wheel_type *wheel, timer_type *timer,
+                     uint64_t expires_ms);
+/* Does nothing if the timer is not pending */
+void timer_wheel_del(timer_wheel_type *wheel, timer_type *timer);
+int timer_pending(const timer_type *timer);
+
+/* Call the timers which have expired at now_ms */
+void timer_wheel_run(timer_wheel_type *wheel, uint64_t now_ms);
+/* Milliseconds until timer_wheel_run() has something to do, at most max_ms */
+int timer_wheel_next_ms(const timer_wheel_type *wheel, uint64_t now_ms,
+                        int max_ms);
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+
+#include "uring.h"
+
+/*****************************************************************************/
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags,
+                              const void *arg, size_t argsz)
+{
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                      flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode,
+                                 const void *arg, unsigned nr_args)
+{
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*****************************************************************************/
+int uring_init(uring_type *ring, unsigned sq_entries, unsigned cq_entries)
+{
+  /* Needed: one mmap() for both rings, waiting with a timeout,
+     and no lost completions when the queue overflows */
+  const unsigned features =
+    IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+  struct io_uring_params p;
+  size_t sq_len;
+  size_t cq_len;
+  char *ring_ptr;
+  unsigned *sq_array;
+  unsigned i;
+  int err;
+
+  memset(ring, 0, sizeof(*ring));
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = cq_entries;
+  ring->fd = sys_io_uring_setup(sq_entries, &p);
+  if (ring->fd < 0) {
+    return -errno;
+  }
+  if ((p.features & features) != features) {
+    close(ring->fd);
+    return -EOPNOTSUPP;
+  }
+  sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  ring->ring_len = sq_len > cq_len ? sq_len : cq_len;
+  ring->ring_ptr = mmap(NULL, ring->ring_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+  if (ring->ring_ptr == MAP_FAILED) {
+    err = -errno;
+    close(ring->fd);
+    return err;
+  }
+  ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    err = -errno;
+    munmap(ring->ring_ptr, ring->ring_len);
+    close(ring->fd);
+    return err;
+  }
+  ring_ptr = ring->ring_ptr;
+  ring->sq_entries = p.sq_entries;
+  ring->sq_mask = *(unsigned *)(ring_ptr + p.sq_off.ring_mask);
+  ring->sq_head = (unsigned *)(ring_ptr + p.sq_off.head);
+  ring->sq_tail = (unsigned *)(ring_ptr + p.sq_off.tail);
+  ring->sqe_tail = *ring->sq_tail;
+  ring->cq_mask = *(unsigned *)(ring_ptr + p.cq_off.ring_mask);
+  ring->cq_head = (unsigned *)(ring_ptr + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(ring_ptr + p.cq_off.tail);
+  ring->cqes = (struct io_uring_cqe *)(ring_ptr + p.cq_off.cqes);
+  /* SQE n is always in slot n */
+  sq_array = (unsigned *)(ring_ptr + p.sq_off.array);
+  for (i = 0; i < p.sq_entries; i++) {
+    sq_array[i] = i;
+  }
+  return 0;
+}
+
+/*****************************************************************************/
+void uring_exit(uring_type *ring)
+{
+  munmap(ring->sqes, ring->sqes_len);
+  munmap(ring->ring_ptr, ring->ring_len);
+  close(ring->fd);
+  ring->fd = -1;
+}
+
+/*****************************************************************************/
+/* Make the filled SQEs visible to the kernel, return how many */
+static unsigned uring_flush_sq(uring_type *ring)
+{
+  __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+  return ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+}
+
+/*****************************************************************************/
+int uring_submit(uring_type *ring)
+{
+  unsigned to_submit = uring_flush_sq(ring);
+  if (to_submit &&
+      sys_io_uring_enter(ring->fd, to_submit, 0, 0, NULL, 0) < 0) {
+    return -errno;
+  }
+  return 0;
+}
+
+/*****************************************************************************/
+/*
+ * Submit and wait for at least one completion.
+ * Returns -ETIME when the timeout expired
+ */
+int uring_submit_and_wait(uring_type *ring, int timeout_ms)
+{
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  unsigned to_submit = uring_flush_sq(ring);
+
+  memset(&arg, 0, sizeof(arg));
+  ts.tv_sec = timeout_ms / 1000;
+  ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = (uint64_t)(uintptr_t)&ts;
+  if (sys_io_uring_enter(ring->fd, to_submit, 1,
+                         IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                         &arg, sizeof(arg)) < 0) {
+    return -errno;
+  }
+  return 0;
+}
+
+/*****************************************************************************/
+struct io_uring_sqe *uring_get_sqe(uring_type *ring)
+{
+  struct io_uring_sqe *sqe;
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (ring->sqe_tail - head >= ring->sq_entries) {
+    /* Full: let the kernel take what we have */
+    if (uring_submit(ring)) {
+      return NULL;
+    }
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->sq_entries) {
+      return NULL;
+    }
+  }
+  sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+  ring->sqe_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/*****************************************************************************/
+struct io_uring_cqe *uring_peek_cqe(uring_type *ring)
+{
+  unsigned head = *ring->cq_head;
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(uring_type *ring)
+{
+  __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************/
+void uring_prep_multishot_accept(struct io_uring_sqe *sqe, int fd)
+{
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+}
+
+void uring_prep_multishot_recv(struct io_uring_sqe *sqe, int fd,
+                               uint16_t bgid)
+{
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = bgid;
+}
+
+void uring_prep_multishot_poll(struct io_uring_sqe *sqe, int fd,
+                               unsigned poll_mask)
+{
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = poll_mask;
+  sqe->len = IORING_POLL_ADD_MULTI;
+}
+
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd,
+                        const struct msghdr *msg, unsigned flags)
+{
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)msg;
+  sqe->len = 1;
+  sqe->msg_flags = flags;
+}
+
+/*****************************************************************************/
+int uring_buf_ring_init(uring_type *ring, uring_buf_ring_type *buf_ring,
+                        unsigned num_bufs, unsigned buf_len, uint16_t bgid)
+{
+  struct io_uring_buf_reg reg;
+  size_t br_len = num_bufs * sizeof(struct io_uring_buf);
+  void *br;
+  unsigned bid;
+
+  memset(buf_ring, 0, sizeof(*buf_ring));
+  if (posix_memalign(&br, (size_t)sysconf(_SC_PAGESIZE), br_len)) {
+    return -ENOMEM;
+  }
+  memset(br, 0, br_len);
+  buf_ring->bufs = malloc((size_t)num_bufs * buf_len);
+  if (!buf_ring->bufs) {
+    free(br);
+    return -ENOMEM;
+  }
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)br;
+  reg.ring_entries = num_bufs;
+  reg.bgid = bgid;
+  if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING,
+                            &reg, 1) < 0) {
+    int err = -errno;
+    free(buf_ring->bufs);
+    free(br);
+    buf_ring->bufs = NULL;
+    return err;
+  }
+  buf_ring->br = br;
+  buf_ring->num_bufs = num_bufs;
+  buf_ring->buf_len = buf_len;
+  buf_ring->bgid = bgid;
+  for (bid = 0; bid < num_bufs; bid++) {
+    uring_buf_ring_put(buf_ring, bid);
+  }
+  return 0;
+}
+
+/*****************************************************************************/
+char *uring_buf_ring_buf(uring_buf_ring_type *buf_ring, unsigned bid)
+{
+  return &buf_ring->bufs[(size_t)bid * buf_ring->buf_len];
+}
+
+void uring_buf_ring_put(uring_buf_ring_type *buf_ring, unsigned bid)
+{
+  struct io_uring_buf *buf;
+  buf = &buf_ring->br->bufs[buf_ring->tail & (buf_ring->num_bufs - 1)];
+  buf->addr = (uint64_t)(uintptr_t)uring_buf_ring_buf(buf_ring, bid);
+  buf->len = buf_ring->buf_len;
+  buf->bid = (uint16_t)bid;
+  buf_ring->tail++;
+  __atomic_store_n(&buf_ring->br->tail, buf_ring->tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,69 @@
+#ifndef URING_H
+#define URING_H
+
+/*
+ * A minimal io_uring wrapper for sock-util.c.
+ * It uses the system calls directly, liburing is not needed
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+typedef struct uring_type {
+  int           fd;
+  /* Submission queue, shared with the kernel */
+  unsigned      sq_entries;
+  unsigned      sq_mask;
+  unsigned      *sq_head;
+  unsigned      *sq_tail;
+  struct io_uring_sqe *sqes;
+  unsigned      sqe_tail;   /* filled, but not yet seen by the kernel */
+  /* Completion queue */
+  unsigned      cq_mask;
+  unsigned      *cq_head;
+  unsigned      *cq_tail;
+  struct io_uring_cqe *cqes;
+  /* for munmap() */
+  void          *ring_ptr;
+  size_t        ring_len;
+  size_t        sqes_len;
+} uring_type;
+
+/* Buffers which the kernel picks for receives, one group */
+typedef struct uring_buf_ring_type {
+  struct io_uring_buf_ring *br;
+  char          *bufs;
+  unsigned      num_bufs;   /* power of 2 */
+  unsigned      buf_len;
+  uint16_t      bgid;
+  uint16_t      tail;
+} uring_buf_ring_type;
+
+/* All return 0 or -errno */
+int  uring_init(uring_type *ring, unsigned sq_entries, unsigned cq_entries);
+void uring_exit(uring_type *ring);
+int  uring_submit(uring_type *ring);
+int  uring_submit_and_wait(uring_type *ring, int timeout_ms);
+
+/* NULL if the submission queue is full, even after submitting */
+struct io_uring_sqe *uring_get_sqe(uring_type *ring);
+/* NULL if there is no completion */
+struct io_uring_cqe *uring_peek_cqe(uring_type *ring);
+void uring_cqe_seen(uring_type *ring);
+
+void uring_prep_multishot_accept(struct io_uring_sqe *sqe, int fd);
+void uring_prep_multishot_recv(struct io_uring_sqe *sqe, int fd,
+                               uint16_t bgid);
+void uring_prep_multishot_poll(struct io_uring_sqe *sqe, int fd,
+                               unsigned poll_mask);
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd,
+                        const struct msghdr *msg, unsigned flags);
+
+int  uring_buf_ring_init(uring_type *ring, uring_buf_ring_type *buf_ring,
+                         unsigned num_bufs, unsigned buf_len, uint16_t bgid);
+char *uring_buf_ring_buf(uring_buf_ring_type *buf_ring, unsigned bid);
+/* Give a buffer back to the kernel */
+void uring_buf_ring_put(uring_buf_ring_type *buf_ring, unsigned bid);
+
+#endif /* URING_H */